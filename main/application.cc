@@ -4,6 +4,11 @@
 #include "system_info.h"
 #include "ml307_ssl_transport.h"
 #include "audio_codec.h"
+#include "codec_benchmark.h"
+#include "pcm_interleave.h"
+#include "sound_cache.h"
+#include "p3_stream.h"
+#include "opus_packet_decoder.h"
 #include "mqtt_protocol.h"
 #include "websocket_protocol.h"
 #include "font_awesome_symbols.h"
@@ -16,6 +21,7 @@
 #include <cJSON.h>
 #include <driver/gpio.h>
 #include <arpa/inet.h>
+#include <algorithm>
 
 #define TAG "Application"
 
@@ -39,7 +45,7 @@ static const char* const STATE_STRINGS[] = {
 
 Application::Application() {
     event_group_ = xEventGroupCreate();
-    background_task_ = new BackgroundTask(4096 * 8);
+    background_task_ = new BackgroundTask();
 
     esp_timer_create_args_t clock_timer_args = {
         .callback = [](void* arg) {
@@ -128,10 +134,8 @@ void Application::CheckNewVersion() {
             auto codec = board.GetAudioCodec();
             codec->EnableInput(false);
             codec->EnableOutput(false);
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                audio_decode_queue_.clear();
-            }
+            audio_decode_queue_.Clear();
+            StopSounds();
             background_task_->WaitForCompletion();
             delete background_task_;
             background_task_ = nullptr;
@@ -205,7 +209,6 @@ void Application::ShowActivationCode() {
         digit_sound{'9', Lang::Sounds::P3_9}
     }};
 
-    // This sentence uses 9KB of SRAM, so we need to wait for it to finish
     Alert(Lang::Strings::ACTIVATION, message.c_str(), "happy", Lang::Sounds::P3_ACTIVATION);
 
     for (const auto& digit : code) {
@@ -224,7 +227,6 @@ void Application::Alert(const char* status, const char* message, const char* emo
     display->SetEmotion(emotion);
     display->SetChatMessage("system", message);
     if (!sound.empty()) {
-        ResetDecoder();
         PlaySound(sound);
     }
 }
@@ -238,33 +240,25 @@ void Application::DismissAlert() {
     }
 }
 
+// Queues an embedded P3 asset for the sound task and returns immediately.
+// Sounds are mixed over server audio instead of replacing it.
 void Application::PlaySound(const std::string_view& sound) {
-    // Wait for the previous sound to finish
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        audio_decode_cv_.wait(lock, [this]() {
-            return audio_decode_queue_.empty();
-        });
-    }
-    background_task_->WaitForCompletion();
+    EnableAudioOutput();
+    last_output_time_ = std::chrono::steady_clock::now();
 
-    // The assets are encoded at 16000Hz, 60ms frame duration
-    SetDecodeSampleRate(16000, 60);
-    const char* data = sound.data();
-    size_t size = sound.size();
-    for (const char* p = data; p < data + size; ) {
-        auto p3 = (BinaryProtocol3*)p;
-        p += sizeof(BinaryProtocol3);
-
-        auto payload_size = ntohs(p3->payload_size);
-        std::vector<uint8_t> opus;
-        opus.resize(payload_size);
-        memcpy(opus.data(), p3->payload, payload_size);
-        p += payload_size;
+    std::lock_guard<std::mutex> lock(sound_mutex_);
+    sound_queue_.push_back(sound);
+    sound_cv_.notify_one();
+}
 
-        std::lock_guard<std::mutex> lock(mutex_);
-        audio_decode_queue_.emplace_back(std::move(opus));
+void Application::StopSounds() {
+    {
+        std::lock_guard<std::mutex> lock(sound_mutex_);
+        sound_queue_.clear();
+        sound_generation_++;
     }
+    // Aborts the write in progress, AudioSoundTask then sees the new generation
+    output_mixer_->voice(AUDIO_VOICE_SOUND).Clear();
 }
 
 void Application::ToggleChatState() {
@@ -298,6 +292,16 @@ void Application::ToggleChatState() {
     }
 }
 
+void Application::PrewarmAudioChannel() {
+#if CONFIG_AUDIO_CHANNEL_PREWARM
+    Schedule([this]() {
+        if (device_state_ == kDeviceStateIdle && protocol_) {
+            protocol_->PrewarmAudioChannel(CONFIG_AUDIO_CHANNEL_PREWARM_TIMEOUT_MS);
+        }
+    });
+#endif
+}
+
 void Application::StartListening() {
     if (device_state_ == kDeviceStateActivating) {
         SetDeviceState(kDeviceStateIdle);
@@ -357,17 +361,24 @@ void Application::Start() {
     /* Setup the audio codec */
     auto codec = board.GetAudioCodec();
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
+    frame_duration_ = realtime_chat_enabled_ ? OPUS_REALTIME_FRAME_DURATION_MS : OPUS_FRAME_DURATION_MS;
+    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration_);
     if (realtime_chat_enabled_) {
-        ESP_LOGI(TAG, "Realtime chat enabled, setting opus encoder complexity to 0");
-        opus_encoder_->SetComplexity(0);
+        ESP_LOGI(TAG, "Realtime chat enabled, setting opus encoder complexity to 0, frame duration %d ms", frame_duration_.load());
+        encoder_complexity_ = 0;
     } else if (board.GetBoardType() == "ml307") {
         ESP_LOGI(TAG, "ML307 board detected, setting opus encoder complexity to 5");
-        opus_encoder_->SetComplexity(5);
+        encoder_complexity_ = 5;
     } else {
         ESP_LOGI(TAG, "WiFi board detected, setting opus encoder complexity to 3");
-        opus_encoder_->SetComplexity(3);
+        encoder_complexity_ = 3;
     }
+    opus_encoder_->SetComplexity(encoder_complexity_);
+
+#if CONFIG_AUDIO_CODEC_BENCHMARK
+    RunOpusEncodeBenchmark(16000, frame_duration_);
+    RunOpusFrameDurationBenchmark(16000, encoder_complexity_);
+#endif
 
     if (codec->input_sample_rate() != 16000) {
         input_resampler_.Configure(codec->input_sample_rate(), 16000);
@@ -375,12 +386,49 @@ void Application::Start() {
     }
     codec->Start();
 
+    // Keep CONFIG_AUDIO_DECODE_AHEAD_MS of decoded audio queued for the codec
+    output_mixer_ = std::make_unique<AudioMixer>(2, codec->output_sample_rate() * CONFIG_AUDIO_DECODE_AHEAD_MS / 1000);
+    output_mixer_->SetDucking(AUDIO_VOICE_SOUND, AUDIO_SOUND_DUCK_GAIN);
+
     xTaskCreatePinnedToCore([](void* arg) {
         Application* app = (Application*)arg;
         app->AudioLoop();
         vTaskDelete(NULL);
     }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_, realtime_chat_enabled_ ? 1 : 0);
 
+    // Decode on the other core when there is one, so it overlaps with I2S input and output
+    xTaskCreatePinnedToCore([](void* arg) {
+        Application* app = (Application*)arg;
+        app->AudioDecodeTask();
+        vTaskDelete(NULL);
+    }, "audio_decode", 4096 * 8, this, 5, &audio_decode_task_handle_,
+        (portNUM_PROCESSORS > 1 && !realtime_chat_enabled_) ? 1 : 0);
+
+    xTaskCreatePinnedToCore([](void* arg) {
+        Application* app = (Application*)arg;
+        app->AudioOutputTask();
+        vTaskDelete(NULL);
+    }, "audio_output", 4096, this, 8, &audio_output_task_handle_, realtime_chat_enabled_ ? 1 : 0);
+
+    xTaskCreate([](void* arg) {
+        Application* app = (Application*)arg;
+        app->AudioSoundTask();
+        vTaskDelete(NULL);
+    }, "audio_sound", 4096 * 6, this, 4, &audio_sound_task_handle_);
+
+    // Capture -> encode -> send runs on its own tasks, the main loop is not involved
+    xTaskCreate([](void* arg) {
+        Application* app = (Application*)arg;
+        app->AudioEncodeTask();
+        vTaskDelete(NULL);
+    }, "audio_encode", 4096 * 8, this, 5, &audio_encode_task_handle_);
+
+    xTaskCreate([](void* arg) {
+        Application* app = (Application*)arg;
+        app->AudioSendTask();
+        vTaskDelete(NULL);
+    }, "audio_send", 4096 * 2, this, 6, &audio_send_task_handle_);
+
     /* Wait for the network to be ready */
     board.StartNetwork();
 
@@ -394,23 +442,23 @@ void Application::Start() {
 #else
     protocol_ = std::make_unique<MqttProtocol>();
 #endif
+    SetFrameDuration(frame_duration_);
     protocol_->OnNetworkError([this](const std::string& message) {
         SetDeviceState(kDeviceStateIdle);
         Alert(Lang::Strings::ERROR, message.c_str(), "sad", Lang::Sounds::P3_EXCLAMATION);
     });
-    protocol_->OnIncomingAudio([this](std::vector<uint8_t>&& data) {
-        const int max_packets_in_queue = 300 / OPUS_FRAME_DURATION_MS;
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (audio_decode_queue_.size() < max_packets_in_queue) {
-            audio_decode_queue_.emplace_back(std::move(data));
+    protocol_->OnIncomingAudio([this](const uint8_t* data, size_t size) {
+        // The packet is copied straight from the protocol's receive slot into the decode ring.
+        // The ring holds the buffer in the shortest frames, longer ones are limited by duration
+        if (audio_decode_queue_.Size() * downlink_frame_duration_ >= CONFIG_AUDIO_DOWNLINK_BUFFER_MS ||
+            !audio_decode_queue_.Push(data, size, false, esp_timer_get_time())) {
+            downlink_dropped_packets_++;
         }
+        PauseDownlinkIfFull();
     });
-    protocol_->OnAudioChannelOpened([this, codec, &board]() {
+    protocol_->OnAudioChannelOpened([this, &board]() {
         board.SetPowerSaveMode(false);
-        if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
-            ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
-                protocol_->server_sample_rate(), codec->output_sample_rate());
-        }
+        downlink_paused_ = false;
         SetDecodeSampleRate(protocol_->server_sample_rate(), protocol_->server_frame_duration());
         auto& thing_manager = iot::ThingManager::GetInstance();
         protocol_->SendIotDescriptors(thing_manager.GetDescriptorsJson());
@@ -441,13 +489,11 @@ void Application::Start() {
                 });
             } else if (strcmp(state->valuestring, "stop") == 0) {
                 Schedule([this]() {
-                    background_task_->WaitForCompletion();
+                    // The server may be seconds ahead of the speaker, AudioOutputTask
+                    // finishes the turn once the buffered answer has played out
                     if (device_state_ == kDeviceStateSpeaking) {
-                        if (listening_mode_ == kListeningModeManualStop) {
-                            SetDeviceState(kDeviceStateIdle);
-                        } else {
-                            SetDeviceState(kDeviceStateListening);
-                        }
+                        tts_stop_pending_ = true;
+                        output_mixer_->Wake();
                     }
                 });
             } else if (strcmp(state->valuestring, "sentence_start") == 0) {
@@ -460,6 +506,11 @@ void Application::Start() {
                 }
             }
         } else if (strcmp(type->valuestring, "stt") == 0) {
+#if CONFIG_AUDIO_LOCAL_ENDPOINT
+            Schedule([this, time_us = esp_timer_get_time()]() {
+                OnServerEndpoint(time_us);
+            });
+#endif
             auto text = cJSON_GetObjectItem(root, "text");
             if (text != NULL) {
                 ESP_LOGI(TAG, ">> %s", text->valuestring);
@@ -509,21 +560,65 @@ void Application::Start() {
     });
     protocol_->Start();
 
+#if CONFIG_USE_WAKE_WORD_DETECT || CONFIG_USE_AUDIO_PROCESSOR
+    bool use_wake_word = false;
+    bool use_audio_processor = false;
+#if CONFIG_USE_WAKE_WORD_DETECT
+    use_wake_word = true;
+#endif
+#if CONFIG_USE_AUDIO_PROCESSOR
+    use_audio_processor = true;
+#endif
+    audio_front_end_.Initialize(codec, use_wake_word, use_audio_processor, realtime_chat_enabled_);
+#endif
+
 #if CONFIG_USE_AUDIO_PROCESSOR
-    audio_processor_.Initialize(codec, realtime_chat_enabled_);
-    audio_processor_.OnOutput([this](std::vector<int16_t>&& data) {
-        background_task_->Schedule([this, data = std::move(data)]() mutable {
-            if (protocol_->IsAudioChannelBusy()) {
+    audio_processor_.Initialize(&audio_front_end_);
+    audio_processor_.OnOutput([this](const int16_t* data, size_t samples) {
+#if CONFIG_AUDIO_LOCAL_ENDPOINT
+        if (listening_mode_ == kListeningModeAutoStop && device_state_ == kDeviceStateListening) {
+#if !CONFIG_AUDIO_LOCAL_ENDPOINT_SHADOW
+            // Nothing after the end of the utterance is encoded or sent
+            if (endpointer_.ended()) {
                 return;
             }
-            opus_encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
-                Schedule([this, opus = std::move(opus)]() {
-                    protocol_->SendAudio(opus);
+#endif
+            if (endpointer_.Process(samples)) {
+                local_endpoint_time_us_ = esp_timer_get_time();
+                Schedule([this]() {
+                    OnLocalEndpoint();
                 });
-            });
-        });
+            }
+        }
+#endif
+        auto queue = [this](const int16_t* pcm, size_t samples) {
+            if (!uplink_pcm_ring_.TryWrite(pcm, samples)) {
+                uplink_dropped_frames_++;
+            }
+        };
+#if CONFIG_AUDIO_UPLINK_DTX
+        // Realtime chat runs the AFE without VAD, so it always streams
+        if (!realtime_chat_enabled_) {
+            size_t gap = uplink_gate_.Process(data, samples, queue);
+            if (gap > 0) {
+                int gap_ms = gap * 1000 / uplink_gate_.sample_rate();
+                ESP_LOGI(TAG, "Uplink resumed after %d ms of suppressed silence", gap_ms);
+                Schedule([this, gap_ms]() {
+                    protocol_->SendAudioGap(gap_ms);
+                });
+            }
+            return;
+        }
+#endif
+        queue(data, samples);
     });
     audio_processor_.OnVadStateChange([this](bool speaking) {
+#if CONFIG_AUDIO_LOCAL_ENDPOINT
+        endpointer_.SetSpeaking(speaking);
+#endif
+#if CONFIG_AUDIO_UPLINK_DTX
+        uplink_gate_.SetSpeaking(speaking);
+#endif
         if (device_state_ == kDeviceStateListening) {
             Schedule([this, speaking]() {
                 if (speaking) {
@@ -539,22 +634,35 @@ void Application::Start() {
 #endif
 
 #if CONFIG_USE_WAKE_WORD_DETECT
-    wake_word_detect_.Initialize(codec);
+    wake_word_detect_.Initialize(&audio_front_end_);
+#if CONFIG_AUDIO_CHANNEL_PREWARM_ON_VAD
+    // Speech starts well before the wake word completes, long enough to hide the hello round trip
+    wake_word_detect_.OnSpeechStart([this]() {
+        PrewarmAudioChannel();
+    });
+#endif
     wake_word_detect_.OnWakeWordDetected([this](const std::string& wake_word) {
-        Schedule([this, &wake_word]() {
+        Schedule([this, &wake_word, wake_time = esp_timer_get_time()]() {
             if (device_state_ == kDeviceStateIdle) {
                 SetDeviceState(kDeviceStateConnecting);
                 wake_word_detect_.EncodeWakeWordData();
 
                 if (!protocol_->OpenAudioChannel()) {
                     wake_word_detect_.StartDetection();
+                    WakeAudioLoop();
                     return;
                 }
                 
                 std::vector<uint8_t> opus;
-                // Encode and send the wake word data to the server
+                // Send the pre-roll encoded while detection was running
+                bool first_packet = true;
                 while (wake_word_detect_.GetWakeWordOpus(opus)) {
                     protocol_->SendAudio(opus);
+                    if (first_packet) {
+                        first_packet = false;
+                        wake_to_uplink_stats_.Add(esp_timer_get_time() - wake_time);
+                        wake_to_uplink_stats_.Log(TAG, "Wake word to first uplink packet");
+                    }
                 }
                 // Set the chat state to wake word detected
                 protocol_->SendWakeWordDetected(wake_word);
@@ -586,6 +694,7 @@ void Application::Start() {
 
 void Application::OnClockTimer() {
     clock_ticks_++;
+    CheckOutputIdle();
 
     // Print the debug info every 10 seconds
     if (clock_ticks_ % 10 == 0) {
@@ -595,6 +704,52 @@ void Application::OnClockTimer() {
         int min_free_sram = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
         ESP_LOGI(TAG, "Free internal: %u minimal internal: %u", free_sram, min_free_sram);
 
+        uint32_t dropped = downlink_dropped_packets_;
+        if (dropped != downlink_dropped_reported_) {
+            ESP_LOGW(TAG, "Downlink audio buffer full, dropped %lu packets (%lu total)",
+                dropped - downlink_dropped_reported_, dropped);
+            downlink_dropped_reported_ = dropped;
+        }
+        int64_t now = esp_timer_get_time();
+        uint32_t loop_wakeups = audio_loop_wakeups_;
+        uint32_t decode_wakeups = audio_decode_wakeups_;
+        uint32_t output_wakeups = audio_output_wakeups_;
+        if (audio_loop_report_time_ != 0) {
+            auto per_second = [this, now](uint32_t wakeups, uint32_t reported) {
+                return (unsigned long)((wakeups - reported) * 1000000LL / (now - audio_loop_report_time_));
+            };
+            ESP_LOGI(TAG, "Audio wakeups/s in %s: loop %lu, decode %lu, output %lu", STATE_STRINGS[device_state_],
+                per_second(loop_wakeups, audio_loop_wakeups_reported_),
+                per_second(decode_wakeups, audio_decode_wakeups_reported_),
+                per_second(output_wakeups, audio_output_wakeups_reported_));
+        }
+        audio_loop_wakeups_reported_ = loop_wakeups;
+        audio_decode_wakeups_reported_ = decode_wakeups;
+        audio_output_wakeups_reported_ = output_wakeups;
+        audio_loop_report_time_ = now;
+
+        dropped = uplink_dropped_frames_;
+        if (dropped != uplink_dropped_reported_) {
+            ESP_LOGW(TAG, "Uplink audio backlog, dropped %lu frames (%lu total)",
+                dropped - uplink_dropped_reported_, dropped);
+            uplink_dropped_reported_ = dropped;
+        }
+
+#if CONFIG_AUDIO_LOCAL_ENDPOINT && !CONFIG_AUDIO_LOCAL_ENDPOINT_SHADOW
+        // The server did not answer a turn that ended locally, give up on it.
+        // In shadow mode the turn did not end, the timestamp only feeds the endpoint stats.
+        int64_t endpoint_time = local_endpoint_time_us_;
+        if (endpoint_time != 0 && esp_timer_get_time() - endpoint_time > 10 * 1000000 &&
+            device_state_ == kDeviceStateListening) {
+            Schedule([this]() {
+                if (device_state_ == kDeviceStateListening && local_endpoint_time_us_ != 0) {
+                    ESP_LOGW(TAG, "No answer after local endpoint");
+                    SetDeviceState(kDeviceStateIdle);
+                }
+            });
+        }
+#endif
+
         // If we have synchronized server time, set the status to clock "HH:MM" if the device is idle
         if (ota_.HasServerTime()) {
             if (device_state_ == kDeviceStateIdle) {
@@ -638,153 +793,407 @@ void Application::MainEventLoop() {
 }
 
 // The Audio Loop is used to input and output audio data
+// Capture only. Reads block on the I2S DMA, so the task runs once per frame while
+// a consumer wants audio and otherwise sleeps until the device state changes.
 void Application::AudioLoop() {
-    auto codec = Board::GetInstance().GetAudioCodec();
     while (true) {
-        OnAudioInput();
-        if (codec->output_enabled()) {
-            OnAudioOutput();
+        audio_loop_wakeups_++;
+        if (!OnAudioInput()) {
+            // The timeout is only a backstop for input switched on without WakeAudioLoop()
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
         }
     }
 }
 
-void Application::OnAudioOutput() {
-    if (busy_decoding_audio_) {
-        return;
+void Application::WakeAudioLoop() {
+    if (audio_loop_task_handle_ != nullptr) {
+        xTaskNotifyGive(audio_loop_task_handle_);
     }
+}
+
+// Switches the speaker on and wakes the decode task, which sleeps while it is off
+void Application::EnableAudioOutput() {
+    Board::GetInstance().GetAudioCodec()->EnableOutput(true);
+    if (audio_decode_task_handle_ != nullptr) {
+        xTaskNotifyGive(audio_decode_task_handle_);
+    }
+}
 
+// Runs once a second from the clock timer
+void Application::CheckOutputIdle() {
     auto now = std::chrono::steady_clock::now();
     auto codec = Board::GetInstance().GetAudioCodec();
     const int max_silence_seconds = 10;
 
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (audio_decode_queue_.empty()) {
-        // Disable the output if there is no audio data for a long time
-        if (device_state_ == kDeviceStateIdle) {
-            auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - last_output_time_).count();
-            if (duration > max_silence_seconds) {
-                codec->EnableOutput(false);
-            }
+    // Disable the output if there is no audio data for a long time
+    if (codec->output_enabled() && device_state_ == kDeviceStateIdle && audio_decode_queue_.Empty() && output_mixer_->Empty()) {
+        auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - last_output_time_).count();
+        if (duration > max_silence_seconds) {
+            Schedule([this]() {
+                if (device_state_ == kDeviceStateIdle && output_mixer_->Empty()) {
+                    Board::GetInstance().GetAudioCodec()->EnableOutput(false);
+                }
+            });
         }
-        return;
     }
+}
 
-    if (device_state_ == kDeviceStateListening) {
-        audio_decode_queue_.clear();
-        audio_decode_cv_.notify_all();
-        return;
-    }
+// Pops Opus packets, decodes and resamples them into the stream voice of the mixer.
+// Writing blocks while the ring is full, which paces decoding to the speaker.
+// Sleeps on the ring while it is empty and on EnableAudioOutput() while the speaker is off.
+void Application::AudioDecodeTask() {
+    auto codec = Board::GetInstance().GetAudioCodec();
+    std::vector<uint8_t> opus;
+    std::vector<int16_t> pcm;
+    std::vector<int16_t> resampled;
+    int64_t arrival_time = 0;
+    LatencyStats wire_stats;  // arrival to first sample reaching the codec
 
-    auto opus = std::move(audio_decode_queue_.front());
-    audio_decode_queue_.pop_front();
-    lock.unlock();
-    audio_decode_cv_.notify_all();
+    while (true) {
+        decode_in_flight_ = false;
+        audio_decode_wakeups_++;
+        if (!codec->output_enabled()) {
+            // The timeout is only a backstop for output switched on without EnableAudioOutput()
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+            continue;
+        }
+        if (!audio_decode_queue_.Wait(1000)) {
+            continue;
+        }
+        // Raised before the packet leaves the ring, so AudioOutputTask never sees
+        // the ring and the mixer empty while a frame is still being decoded
+        decode_in_flight_ = true;
+        if (!audio_decode_queue_.Pop(opus, &arrival_time)) {
+            continue;
+        }
+        ResumeDownlinkIfDrained();
 
-    busy_decoding_audio_ = true;
-    background_task_->Schedule([this, codec, opus = std::move(opus)]() mutable {
-        busy_decoding_audio_ = false;
+        if (device_state_ == kDeviceStateListening) {
+            audio_decode_queue_.Clear();
+            ResumeDownlinkIfDrained();
+            continue;
+        }
         if (aborted_) {
-            return;
+            continue;
         }
 
-        std::vector<int16_t> pcm;
-        if (!opus_decoder_->Decode(std::move(opus), pcm)) {
-            return;
+        {
+            std::lock_guard<std::mutex> lock(decoder_mutex_);
+            // An empty packet marks a frame lost in transit, decoding it runs Opus packet loss concealment
+            if (!opus_decoder_->Decode(std::move(opus), pcm)) {
+                continue;
+            }
+            // Resample if the sample rate is different
+            if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
+                resampled.resize(output_resampler_.GetOutputSamples(pcm.size()));
+                output_resampler_.Process(pcm.data(), pcm.size(), resampled.data());
+                pcm.swap(resampled);
+            }
+        }
+        auto& stream = output_mixer_->voice(AUDIO_VOICE_STREAM);
+        stream.Write(pcm.data(), pcm.size());
+
+        // Local sounds carry no arrival time
+        if (arrival_time > 0) {
+            int64_t queued_us = (int64_t)(stream.Size() - std::min(stream.Size(), pcm.size()))
+                * 1000000 / codec->output_sample_rate();
+            wire_stats.Add(esp_timer_get_time() - arrival_time + queued_us);
+            if (wire_stats.count() >= 10000u / downlink_frame_duration_) {
+                wire_stats.Log(TAG, "Wire to speaker");
+                wire_stats.Reset();
+            }
         }
-        // Resample if the sample rate is different
-        if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-            int target_size = output_resampler_.GetOutputSamples(pcm.size());
-            std::vector<int16_t> resampled(target_size);
-            output_resampler_.Process(pcm.data(), pcm.size(), resampled.data());
-            pcm = std::move(resampled);
+    }
+}
+
+// Mixes the stream and sound voices into the codec. Sleeps in Mix() until a voice
+// has samples, or the mixer is woken for a pending abort or end of turn.
+void Application::AudioOutputTask() {
+    auto codec = Board::GetInstance().GetAudioCodec();
+    const size_t chunk_samples = codec->output_sample_rate() * 20 / 1000;
+    std::vector<int16_t> pcm(chunk_samples);
+
+    while (true) {
+        audio_output_wakeups_++;
+        pcm.resize(chunk_samples);
+        // While a turn is ending the decode task may still be finishing the last frame without
+        // writing anything, so the end of turn check below is repeated until it has drained
+        size_t samples = output_mixer_->Mix(pcm.data(), pcm.size(), tts_stop_pending_ ? 100 : 1000);
+        if (samples == 0) {
+            // Nothing was playing when the abort came in
+            abort_time_us_ = 0;
+            // Checked in the order the decode task fills them: ring, in-flight frame, mixer
+            if (tts_stop_pending_ && audio_decode_queue_.Empty() && !decode_in_flight_ &&
+                output_mixer_->voice(AUDIO_VOICE_STREAM).Empty()) {
+                tts_stop_pending_ = false;
+                Schedule([this]() {
+                    if (device_state_ == kDeviceStateSpeaking) {
+                        if (listening_mode_ == kListeningModeManualStop) {
+                            SetDeviceState(kDeviceStateIdle);
+                        } else {
+                            SetDeviceState(kDeviceStateListening);
+                        }
+                    }
+                });
+            }
+            continue;
         }
+
+        pcm.resize(samples);
         codec->OutputData(pcm);
         last_output_time_ = std::chrono::steady_clock::now();
-    });
+
+        int64_t abort_time = abort_time_us_;
+        if (abort_time != 0 && output_mixer_->voice(AUDIO_VOICE_STREAM).Empty()) {
+            abort_time_us_ = 0;
+            barge_in_stats_.Add(esp_timer_get_time() - abort_time);
+            barge_in_stats_.Log(TAG, "Barge-in to silence");
+        }
+    }
 }
 
-void Application::OnAudioInput() {
-#if CONFIG_USE_WAKE_WORD_DETECT
-    if (wake_word_detect_.IsDetectionRunning()) {
-        std::vector<int16_t> data;
-        int samples = wake_word_detect_.GetFeedSize();
-        if (samples > 0) {
-            ReadAudio(data, 16000, samples);
-            wake_word_detect_.Feed(data);
-            return;
+// Encodes captured audio as soon as a frame is available and queues the packets
+// for AudioSendTask, so a slow transport never stalls capture or encoding.
+void Application::AudioEncodeTask() {
+    std::vector<int16_t> pcm;
+    LatencyStats wait_stats;
+    LatencyStats encode_stats;
+
+    while (true) {
+        // The encoder buffers partial frames, so a duration change mid-read only costs one odd-sized read
+        const int frame_duration = frame_duration_;
+        pcm.resize(16000 * frame_duration / 1000);
+        size_t samples = uplink_pcm_ring_.Read(pcm.data(), pcm.size(), 1000);
+        if (samples == 0) {
+            continue;
+        }
+        // The newest sample handed to the encoder was captured roughly when the rest of the ring was not yet
+        int64_t now = esp_timer_get_time();
+        int64_t backlog_us = (int64_t)uplink_pcm_ring_.Size() * 1000000 / 16000;
+        int64_t capture_time = now - backlog_us;
+        pcm.resize(samples);
+
+        {
+            std::lock_guard<std::mutex> lock(encoder_mutex_);
+            opus_encoder_->Encode(std::move(pcm), [this, capture_time](std::vector<uint8_t>&& opus) {
+                if (!uplink_send_queue_.Push(opus.data(), opus.size(), false, capture_time)) {
+                    uplink_dropped_frames_++;
+                }
+            });
+        }
+        wait_stats.Add(backlog_us);
+        encode_stats.Add(esp_timer_get_time() - now);
+
+        if (encode_stats.count() >= 10000u / frame_duration) {
+            wait_stats.Log(TAG, "Uplink capture backlog");
+            encode_stats.Log(TAG, "Uplink encode");
+            wait_stats.Reset();
+            encode_stats.Reset();
         }
     }
-#endif
-#if CONFIG_USE_AUDIO_PROCESSOR
-    if (audio_processor_.IsRunning()) {
-        std::vector<int16_t> data;
-        int samples = audio_processor_.GetFeedSize();
+}
+
+// Hands encoded packets to the transport in order
+void Application::AudioSendTask() {
+    std::vector<uint8_t> opus;
+    int64_t capture_time = 0;
+    LatencyStats send_stats;
+    LatencyStats total_stats;  // capture to handed to the transport
+
+    while (true) {
+        if (!uplink_send_queue_.Pop(opus, 1000, &capture_time)) {
+            continue;
+        }
+        if (!protocol_) {
+            continue;
+        }
+        // A slow transport backs up into uplink_send_queue_ and drops there. The busy flag
+        // still matters for senders outside this task, e.g. the wake word pre-roll flush.
+        if (protocol_->IsAudioChannelBusy()) {
+            uplink_dropped_frames_++;
+            continue;
+        }
+
+        int64_t start = esp_timer_get_time();
+        protocol_->SendAudio(opus);
+        int64_t end = esp_timer_get_time();
+        send_stats.Add(end - start);
+        total_stats.Add(end - capture_time);
+
+        if (send_stats.count() >= 10000u / frame_duration_) {
+            send_stats.Log(TAG, "Uplink send");
+            total_stats.Log(TAG, "Mic to wire");
+            send_stats.Reset();
+            total_stats.Reset();
+        }
+    }
+}
+
+// Decodes queued P3 assets into the sound voice of the mixer with a decoder of
+// its own, so sounds never disturb the stream decoder state or sample rate.
+// Decoded clips are kept in a PCM cache, replaying one skips Opus entirely.
+void Application::AudioSoundTask() {
+    auto codec = Board::GetInstance().GetAudioCodec();
+    const int output_rate = codec->output_sample_rate();
+    // The assets are encoded at 16000Hz, 60ms frame duration
+    const size_t frame_samples = output_rate * 60 / 1000;
+    OpusPacketDecoder decoder(16000, 1, 60);
+    AudioResampler resampler;
+    if (output_rate != 16000) {
+        resampler.Configure(16000, output_rate);
+    }
+    SoundCache cache(CONFIG_AUDIO_SOUND_CACHE_KB * 1024);
+    auto& voice = output_mixer_->voice(AUDIO_VOICE_SOUND);
+    std::vector<int16_t> pcm;
+    std::vector<int16_t> resampled;
+
+    while (true) {
+        std::string_view sound;
+        uint32_t generation;
+        {
+            std::unique_lock<std::mutex> lock(sound_mutex_);
+            sound_cv_.wait(lock, [this]() { return !sound_queue_.empty(); });
+            sound = sound_queue_.front();
+            sound_queue_.pop_front();
+            generation = sound_generation_;
+        }
+        auto playing = [&]() {
+            return codec->output_enabled() && sound_generation_ == generation;
+        };
+        int64_t start_time = esp_timer_get_time();
+        int64_t first_sample_time = 0;
+
+        const int16_t* cached;
+        size_t cached_samples;
+        if (cache.Find(sound.data(), cached, cached_samples)) {
+            for (size_t offset = 0; offset < cached_samples && playing(); offset += frame_samples) {
+                voice.Write(cached + offset, std::min(frame_samples, cached_samples - offset));
+                if (first_sample_time == 0) {
+                    first_sample_time = esp_timer_get_time();
+                }
+            }
+            ESP_LOGI(TAG, "Sound first sample in %lld us (cached)", first_sample_time - start_time);
+            continue;
+        }
+
+        // Every packet decodes to one 60ms frame, size the clip from the packet count
+        P3Stream stream(sound);
+        size_t clip_capacity = stream.CountPackets() * (frame_samples + 1);
+        int16_t* clip = cache.Allocate(clip_capacity);
+        size_t clip_samples = 0;
+
+        decoder.ResetState();
+        resampler.Reset();
+        const uint8_t* payload;
+        size_t payload_size;
+        while (playing() && stream.Next(payload, payload_size)) {
+            // Decoded straight from the asset, no copy out of flash
+            if (!decoder.Decode(payload, payload_size, pcm)) {
+                continue;
+            }
+            if (output_rate != 16000) {
+                resampled.resize(resampler.GetOutputSamples(pcm.size()));
+                resampler.Process(pcm.data(), pcm.size(), resampled.data());
+                pcm.swap(resampled);
+            }
+            if (clip != nullptr && clip_samples + pcm.size() <= clip_capacity) {
+                memcpy(clip + clip_samples, pcm.data(), pcm.size() * sizeof(int16_t));
+                clip_samples += pcm.size();
+            }
+            // Blocks while the voice is full, which paces the sound to the speaker
+            voice.Write(pcm.data(), pcm.size());
+            if (first_sample_time == 0) {
+                first_sample_time = esp_timer_get_time();
+            }
+        }
+        ESP_LOGI(TAG, "Sound first sample in %lld us (decoded)", first_sample_time - start_time);
+
+        if (clip != nullptr) {
+            // Only complete clips go into the cache
+            if (playing()) {
+                cache.Insert(sound.data(), clip, clip_samples);
+            } else {
+                cache.Free(clip);
+            }
+        }
+    }
+}
+
+bool Application::OnAudioInput() {
+#if CONFIG_USE_WAKE_WORD_DETECT || CONFIG_USE_AUDIO_PROCESSOR
+    if (audio_front_end_.IsRunning()) {
+        auto& data = input_frame_;
+        int samples = audio_front_end_.GetFeedSize();
         if (samples > 0) {
-            ReadAudio(data, 16000, samples);
-            audio_processor_.Feed(data);
-            return;
+            if (!ReadAudio(data, 16000, samples)) {
+                return false;
+            }
+            audio_front_end_.Feed(data);
+            return true;
         }
     }
-#else
+#endif
+#if !CONFIG_USE_AUDIO_PROCESSOR
     if (device_state_ == kDeviceStateListening) {
-        std::vector<int16_t> data;
-        ReadAudio(data, 16000, 30 * 16000 / 1000);
-        background_task_->Schedule([this, data = std::move(data)]() mutable {
-            if (protocol_->IsAudioChannelBusy()) {
-                return;
-            }
-            opus_encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
-                Schedule([this, opus = std::move(opus)]() {
-                    protocol_->SendAudio(opus);
-                });
-            });
-        });
-        return;
+        auto& data = input_frame_;
+        if (!ReadAudio(data, 16000, 30 * 16000 / 1000)) {
+            return false;
+        }
+        if (!uplink_pcm_ring_.TryWrite(data.data(), data.size())) {
+            uplink_dropped_frames_++;
+        }
+        return true;
     }
 #endif
-    vTaskDelay(pdMS_TO_TICKS(30));
+    return false;
 }
 
-void Application::ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples) {
+bool Application::ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples) {
     auto codec = Board::GetInstance().GetAudioCodec();
     if (codec->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec->input_sample_rate() / sample_rate);
-        if (!codec->InputData(data)) {
-            return;
+        // The scratch buffers keep their capacity, so this allocates only on the first call
+        input_raw_.resize(samples * codec->input_sample_rate() / sample_rate);
+        if (!codec->InputData(input_raw_)) {
+            return false;
         }
         if (codec->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
+            size_t frames = input_raw_.size() / 2;
+            input_mic_.resize(frames);
+            input_reference_.resize(frames);
+            int16_t* channels[] = {input_mic_.data(), input_reference_.data()};
+            DeinterleavePcm(input_raw_.data(), 2, channels, frames);
+
+            resampled_mic_.resize(input_resampler_.GetOutputSamples(frames));
+            resampled_reference_.resize(reference_resampler_.GetOutputSamples(frames));
+            input_resampler_.Process(input_mic_.data(), frames, resampled_mic_.data());
+            reference_resampler_.Process(input_reference_.data(), frames, resampled_reference_.data());
+
+            const int16_t* resampled[] = {resampled_mic_.data(), resampled_reference_.data()};
+            data.resize(resampled_mic_.size() * 2);
+            InterleavePcm(resampled, 2, data.data(), resampled_mic_.size());
         } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
+            data.resize(input_resampler_.GetOutputSamples(input_raw_.size()));
+            input_resampler_.Process(input_raw_.data(), input_raw_.size(), data.data());
         }
     } else {
         data.resize(samples);
         if (!codec->InputData(data)) {
-            return;
+            return false;
         }
     }
+    return true;
 }
 
 void Application::AbortSpeaking(AbortReason reason) {
     ESP_LOGI(TAG, "Abort speaking");
+    abort_time_us_ = esp_timer_get_time();
+    // Lets the output task see the abort even if nothing is playing
+    output_mixer_->Wake();
     aborted_ = true;
     protocol_->SendAbortSpeaking(reason);
+    // The buffer may hold seconds of the aborted answer
+    audio_decode_queue_.Clear();
+    ResumeDownlinkIfDrained();
 }
 
 void Application::SetListeningMode(ListeningMode mode) {
@@ -813,11 +1222,12 @@ void Application::SetDeviceState(DeviceState state) {
         case kDeviceStateIdle:
             display->SetStatus(Lang::Strings::STANDBY);
             display->SetEmotion("neutral");
-#if CONFIG_USE_AUDIO_PROCESSOR
-            audio_processor_.Stop();
-#endif
+            // Enable the next front end feature before disabling the current one, so the pipeline keeps running
 #if CONFIG_USE_WAKE_WORD_DETECT
             wake_word_detect_.StartDetection();
+#endif
+#if CONFIG_USE_AUDIO_PROCESSOR
+            audio_processor_.Stop();
 #endif
             break;
         case kDeviceStateConnecting:
@@ -844,24 +1254,25 @@ void Application::SetDeviceState(DeviceState state) {
                     // FIXME: Wait for the speaker to empty the buffer
                     vTaskDelay(pdMS_TO_TICKS(120));
                 }
-                opus_encoder_->ResetState();
-#if CONFIG_USE_WAKE_WORD_DETECT
-                wake_word_detect_.StopDetection();
-#endif
+                ResetEncoder();
 #if CONFIG_USE_AUDIO_PROCESSOR
                 audio_processor_.Start();
+#endif
+#if CONFIG_USE_WAKE_WORD_DETECT
+                wake_word_detect_.StopDetection();
 #endif
             }
             break;
         case kDeviceStateSpeaking:
             display->SetStatus(Lang::Strings::SPEAKING);
+            tts_stop_pending_ = false;
 
             if (listening_mode_ != kListeningModeRealtime) {
-#if CONFIG_USE_AUDIO_PROCESSOR
-                audio_processor_.Stop();
-#endif
 #if CONFIG_USE_WAKE_WORD_DETECT
                 wake_word_detect_.StartDetection();
+#endif
+#if CONFIG_USE_AUDIO_PROCESSOR
+                audio_processor_.Stop();
 #endif
             }
             ResetDecoder();
@@ -870,28 +1281,160 @@ void Application::SetDeviceState(DeviceState state) {
             // Do nothing
             break;
     }
+    // Input may have been switched on or off
+    WakeAudioLoop();
+}
+
+void Application::ResetEncoder() {
+    std::lock_guard<std::mutex> lock(encoder_mutex_);
+    uplink_pcm_ring_.Clear();
+#if CONFIG_AUDIO_UPLINK_DTX
+    uplink_gate_.Reset();
+#endif
+#if CONFIG_AUDIO_LOCAL_ENDPOINT
+    endpointer_.Reset();
+    local_endpoint_time_us_ = 0;
+#endif
+    if (opus_encoder_->duration_ms() != frame_duration_) {
+        opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration_);
+        opus_encoder_->SetComplexity(encoder_complexity_);
+    } else {
+        opus_encoder_->ResetState();
+    }
+    uplink_send_queue_.Clear();
 }
 
+#if CONFIG_AUDIO_LOCAL_ENDPOINT
+// The utterance ended on the device. The server is told right away instead of
+// waiting for its own VAD, unless the endpointer only runs for telemetry.
+void Application::OnLocalEndpoint() {
+    if (device_state_ != kDeviceStateListening || listening_mode_ != kListeningModeAutoStop) {
+        return;
+    }
+#if CONFIG_AUDIO_LOCAL_ENDPOINT_SHADOW
+    ESP_LOGI(TAG, "Local endpoint (shadow mode, still streaming)");
+#else
+    ESP_LOGI(TAG, "Local endpoint, stop listening");
+    protocol_->SendStopListening();
+#endif
+}
+
+// The server transcript marks its endpoint. In shadow mode the difference is how much
+// earlier the device would have ended the turn; otherwise it is the server turnaround.
+void Application::OnServerEndpoint(int64_t time_us) {
+    int64_t local_time = local_endpoint_time_us_.exchange(0);
+    if (local_time == 0) {
+        ESP_LOGI(TAG, "Server endpoint without a local one");
+        return;
+    }
+    endpoint_stats_.Add(time_us - local_time);
+    endpoint_stats_.Log(TAG, "Local endpoint to server transcript");
+}
+#endif
+
 void Application::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(decoder_mutex_);
     opus_decoder_->ResetState();
-    audio_decode_queue_.clear();
-    audio_decode_cv_.notify_all();
+    audio_decode_queue_.Clear();
+    output_mixer_->voice(AUDIO_VOICE_STREAM).Clear();
+    ResumeDownlinkIfDrained();
     last_output_time_ = std::chrono::steady_clock::now();
-    
-    auto codec = Board::GetInstance().GetAudioCodec();
-    codec->EnableOutput(true);
+    EnableAudioOutput();
+}
+
+// Ask the server to pause pushing audio when the downlink buffer passes the high
+// watermark. Only network audio counts, local sounds never pause the server.
+void Application::PauseDownlinkIfFull() {
+    const size_t high_watermark_ms = CONFIG_AUDIO_DOWNLINK_BUFFER_MS * CONFIG_AUDIO_DOWNLINK_HIGH_WATERMARK / 100;
+    bool paused = false;
+    if (audio_decode_queue_.Size() * downlink_frame_duration_ >= high_watermark_ms && downlink_paused_.compare_exchange_strong(paused, true)) {
+        Schedule([this]() {
+            protocol_->SendFlowControl(true);
+        });
+    }
+}
+
+// Let the server resume once the decoder has drained the buffer below the low watermark
+void Application::ResumeDownlinkIfDrained() {
+    const size_t low_watermark_ms = CONFIG_AUDIO_DOWNLINK_BUFFER_MS * CONFIG_AUDIO_DOWNLINK_LOW_WATERMARK / 100;
+    bool paused = true;
+    if (audio_decode_queue_.Size() * downlink_frame_duration_ <= low_watermark_ms && downlink_paused_.compare_exchange_strong(paused, false)) {
+        Schedule([this]() {
+            protocol_->SendFlowControl(false);
+        });
+    }
+}
+
+static bool IsOpusSampleRate(int sample_rate) {
+    return sample_rate == 8000 || sample_rate == 12000 || sample_rate == 16000 ||
+        sample_rate == 24000 || sample_rate == 48000;
+}
+
+// Opus can decode any stream at any of its own rates, so a codec running at
+// one of them needs no resampler at all; the server is still asked to send
+// that rate so no bandwidth is spent on bands the speaker can't play.
+// Other rates (e.g. 44.1k) get the nearest rate above them first.
+std::vector<int> Application::GetPreferredDownlinkRates(int output_sample_rate) {
+    std::vector<int> rates;
+    if (IsOpusSampleRate(output_sample_rate)) {
+        rates.push_back(output_sample_rate);
+    } else if (output_sample_rate > 24000) {
+        rates.push_back(48000);
+    }
+    for (int rate : {24000, 16000}) {
+        if (std::find(rates.begin(), rates.end(), rate) == rates.end()) {
+            rates.push_back(rate);
+        }
+    }
+    return rates;
+}
+
+// The session duration first, then the other durations the packet queues can hold
+std::vector<int> Application::GetPreferredFrameDurations(int frame_duration) {
+    std::vector<int> durations = {frame_duration};
+    for (int duration : {20, 40, 60}) {
+        if (duration != frame_duration && duration >= OPUS_MIN_FRAME_DURATION_MS) {
+            durations.push_back(duration);
+        }
+    }
+    return durations;
+}
+
+void Application::SetFrameDuration(int duration_ms) {
+    if ((duration_ms != 20 && duration_ms != 40 && duration_ms != 60) || duration_ms < OPUS_MIN_FRAME_DURATION_MS) {
+        ESP_LOGW(TAG, "Unsupported frame duration %d ms", duration_ms);
+        return;
+    }
+    frame_duration_ = duration_ms;
+#if CONFIG_USE_WAKE_WORD_DETECT
+    wake_word_detect_.SetFrameDuration(duration_ms);
+#endif
+    if (protocol_) {
+        auto codec = Board::GetInstance().GetAudioCodec();
+        protocol_->SetUplinkFrameDuration(duration_ms);
+        protocol_->SetPreferredDownlink(GetPreferredDownlinkRates(codec->output_sample_rate()),
+            GetPreferredFrameDurations(duration_ms));
+    }
 }
 
 void Application::SetDecodeSampleRate(int sample_rate, int frame_duration) {
+    auto codec = Board::GetInstance().GetAudioCodec();
+    if (IsOpusSampleRate(codec->output_sample_rate())) {
+        sample_rate = codec->output_sample_rate();
+    }
+    if (frame_duration <= 0) {
+        frame_duration = OPUS_FRAME_DURATION_MS;
+    }
+
+    std::lock_guard<std::mutex> lock(decoder_mutex_);
     if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
         return;
     }
 
     opus_decoder_.reset();
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+    downlink_frame_duration_ = frame_duration;
 
-    auto codec = Board::GetInstance().GetAudioCodec();
     if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
         ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
         output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
@@ -8,18 +8,28 @@
 
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <list>
 #include <vector>
-#include <condition_variable>
 
 #include <opus_encoder.h>
 #include <opus_decoder.h>
-#include <opus_resampler.h>
 
 #include "protocol.h"
 #include "ota.h"
 #include "background_task.h"
-
+#include "audio_packet_ring.h"
+#include "pcm_ring.h"
+#include "audio_mixer.h"
+#include "audio_resampler.h"
+#include "latency_stats.h"
+#include "vad_gate.h"
+#include "endpointer.h"
+
+#if CONFIG_USE_WAKE_WORD_DETECT || CONFIG_USE_AUDIO_PROCESSOR
+#include "audio_front_end.h"
+#endif
 #if CONFIG_USE_WAKE_WORD_DETECT
 #include "wake_word_detect.h"
 #endif
@@ -45,7 +55,30 @@ enum DeviceState {
     kDeviceStateFatalError
 };
 
+// Frame duration outside realtime chat. Realtime chat trades bandwidth for latency with
+// shorter frames, the packet queues are sized for the shortest duration a session may use.
 #define OPUS_FRAME_DURATION_MS 60
+#if CONFIG_USE_REALTIME_CHAT
+#define OPUS_REALTIME_FRAME_DURATION_MS CONFIG_REALTIME_CHAT_FRAME_DURATION_MS
+#define OPUS_MIN_FRAME_DURATION_MS 20
+#else
+#define OPUS_REALTIME_FRAME_DURATION_MS OPUS_FRAME_DURATION_MS
+#define OPUS_MIN_FRAME_DURATION_MS OPUS_FRAME_DURATION_MS
+#endif
+#define AUDIO_DECODE_MAX_PACKET_SIZE 1024
+#define AUDIO_DECODE_QUEUE_PACKETS (CONFIG_AUDIO_DOWNLINK_BUFFER_MS / OPUS_MIN_FRAME_DURATION_MS)
+// Output mixer voices: server audio and local sounds
+#define AUDIO_VOICE_STREAM 0
+#define AUDIO_VOICE_SOUND 1
+#define AUDIO_SOUND_DUCK_GAIN 0.3f
+#if CONFIG_AUDIO_UPLINK_DTX
+// Room for the pre-roll that the DTX gate releases in one go at a speech onset
+#define AUDIO_UPLINK_PCM_BUFFER_MS (240 + CONFIG_AUDIO_UPLINK_DTX_PREROLL_MS)
+#else
+#define AUDIO_UPLINK_PCM_BUFFER_MS 240
+#endif
+#define AUDIO_UPLINK_MAX_PACKET_SIZE 512
+#define AUDIO_UPLINK_QUEUE_PACKETS (480 / OPUS_MIN_FRAME_DURATION_MS)
 
 class Application {
 public:
@@ -68,6 +101,9 @@ public:
     void ToggleChatState();
     void StartListening();
     void StopListening();
+    // Starts the audio channel handshake while idle when a conversation is likely
+    // to follow, e.g. on button press-down. No-op without CONFIG_AUDIO_CHANNEL_PREWARM
+    void PrewarmAudioChannel();
     void UpdateIotStates();
     void Reboot();
     void WakeWordInvoke(const std::string& wake_word);
@@ -75,11 +111,16 @@ public:
     bool CanEnterSleepMode();
     Protocol* GetProtocol() const;
     void SetListeningMode(ListeningMode mode);
+    // 20, 40 or 60 ms, takes effect with the next audio channel and listening session
+    void SetFrameDuration(int duration_ms);
 
 private:
     Application();
     ~Application();
 
+#if CONFIG_USE_WAKE_WORD_DETECT || CONFIG_USE_AUDIO_PROCESSOR
+    AudioFrontEnd audio_front_end_;
+#endif
 #if CONFIG_USE_WAKE_WORD_DETECT
     WakeWordDetect wake_word_detect_;
 #endif
@@ -101,34 +142,110 @@ private:
 #endif
     bool aborted_ = false;
     bool voice_detected_ = false;
-    bool busy_decoding_audio_ = false;
+    std::atomic<bool> tts_stop_pending_{false};
+    // A packet has left the decode ring but its PCM is not in the mixer yet
+    std::atomic<bool> decode_in_flight_{false};
     int clock_ticks_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
 
     // Audio encode / decode
     TaskHandle_t audio_loop_task_handle_ = nullptr;
+    std::atomic<uint32_t> audio_loop_wakeups_{0};
+    uint32_t audio_loop_wakeups_reported_ = 0;
+    int64_t audio_loop_report_time_ = 0;
+    std::atomic<uint32_t> audio_decode_wakeups_{0};
+    uint32_t audio_decode_wakeups_reported_ = 0;
+    std::atomic<uint32_t> audio_output_wakeups_{0};
+    uint32_t audio_output_wakeups_reported_ = 0;
+    TaskHandle_t audio_decode_task_handle_ = nullptr;
+    TaskHandle_t audio_output_task_handle_ = nullptr;
+    TaskHandle_t audio_encode_task_handle_ = nullptr;
+    TaskHandle_t audio_send_task_handle_ = nullptr;
     BackgroundTask* background_task_ = nullptr;
     std::chrono::steady_clock::time_point last_output_time_;
-    std::list<std::vector<uint8_t>> audio_decode_queue_;
-    std::condition_variable audio_decode_cv_;
+    AudioPacketRing audio_decode_queue_{AUDIO_DECODE_QUEUE_PACKETS, AUDIO_DECODE_MAX_PACKET_SIZE};
+    std::atomic<int> downlink_frame_duration_{OPUS_FRAME_DURATION_MS};
+    std::atomic<bool> downlink_paused_{false};
+    std::atomic<uint32_t> downlink_dropped_packets_{0};
+    uint32_t downlink_dropped_reported_ = 0;
+    // 16kHz mono capture waiting for the encoder, then Opus packets waiting for the transport
+    PcmRing uplink_pcm_ring_{16000 * AUDIO_UPLINK_PCM_BUFFER_MS / 1000};
+#if CONFIG_AUDIO_LOCAL_ENDPOINT
+    // Only touched by the audio processor task, plus ResetEncoder while it is stopped
+    Endpointer endpointer_{16000, CONFIG_AUDIO_LOCAL_ENDPOINT_SILENCE_MS, CONFIG_AUDIO_LOCAL_ENDPOINT_MIN_SPEECH_MS};
+    // When the current turn ended locally, cleared once the server has answered
+    std::atomic<int64_t> local_endpoint_time_us_{0};
+    LatencyStats endpoint_stats_;
+#endif
+#if CONFIG_AUDIO_UPLINK_DTX
+    // Only touched by the audio processor task, plus ResetEncoder while it is stopped
+    VadGate uplink_gate_{16000, CONFIG_AUDIO_UPLINK_DTX_HANGOVER_MS, CONFIG_AUDIO_UPLINK_DTX_PREROLL_MS};
+#endif
+    AudioPacketRing uplink_send_queue_{AUDIO_UPLINK_QUEUE_PACKETS, AUDIO_UPLINK_MAX_PACKET_SIZE, false};
+    std::atomic<uint32_t> uplink_dropped_frames_{0};
+    uint32_t uplink_dropped_reported_ = 0;
 
     std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
+    int encoder_complexity_ = 3;
+    // Uplink frame duration of the current session
+    std::atomic<int> frame_duration_{OPUS_FRAME_DURATION_MS};
     std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
-
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
-    OpusResampler output_resampler_;
+    // Guards opus_encoder_ against the encoder task
+    std::mutex encoder_mutex_;
+    // Guards opus_decoder_ and output_resampler_ against the decoder task
+    std::mutex decoder_mutex_;
+    std::unique_ptr<AudioMixer> output_mixer_;
+    // Assets waiting for the sound task, they live in flash so views are enough
+    std::mutex sound_mutex_;
+    std::condition_variable sound_cv_;
+    std::list<std::string_view> sound_queue_;
+    // Bumped by StopSounds(), the clip being played stops when it changes
+    std::atomic<uint32_t> sound_generation_{0};
+    TaskHandle_t audio_sound_task_handle_ = nullptr;
+    // Set by AbortSpeaking, cleared by the output task once the speaker is silent
+    std::atomic<int64_t> abort_time_us_{0};
+    LatencyStats barge_in_stats_;
+    // Main task only
+    LatencyStats wake_to_uplink_stats_;
+
+    // Audio loop scratch, reused by OnAudioInput / ReadAudio
+    std::vector<int16_t> input_frame_;
+    std::vector<int16_t> input_raw_;
+    std::vector<int16_t> input_mic_;
+    std::vector<int16_t> input_reference_;
+    std::vector<int16_t> resampled_mic_;
+    std::vector<int16_t> resampled_reference_;
+
+    AudioResampler input_resampler_;
+    AudioResampler reference_resampler_;
+    AudioResampler output_resampler_;
 
     void MainEventLoop();
-    void OnAudioInput();
-    void OnAudioOutput();
-    void ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples);
+    // True if a frame was captured, false if nothing needs input right now
+    bool OnAudioInput();
+    void CheckOutputIdle();
+    void WakeAudioLoop();
+    void EnableAudioOutput();
+    bool ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
+    void PauseDownlinkIfFull();
+    void ResumeDownlinkIfDrained();
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    static std::vector<int> GetPreferredDownlinkRates(int output_sample_rate);
+    static std::vector<int> GetPreferredFrameDurations(int frame_duration);
     void CheckNewVersion();
     void ShowActivationCode();
     void OnClockTimer();
     void AudioLoop();
+    void AudioDecodeTask();
+    void AudioOutputTask();
+    void AudioSoundTask();
+    void StopSounds();
+    void AudioEncodeTask();
+    void AudioSendTask();
+    void ResetEncoder();
+    void OnLocalEndpoint();
+    void OnServerEndpoint(int64_t time_us);
 };
 
 #endif // _APPLICATION_H_
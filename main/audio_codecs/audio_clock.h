@@ -0,0 +1,51 @@
+#ifndef _AUDIO_CLOCK_H
+#define _AUDIO_CLOCK_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+
+#include "audio_codec.h"
+
+// Stands in for the I2S clock in codecs that have no hardware behind them.
+// Advance() blocks until the given frames would have been clocked out at
+// sample_rate * speed. A speed of 0 or less disables pacing.
+class AudioClock {
+public:
+    AudioClock(int sample_rate, float speed) : sample_rate_(sample_rate), speed_(speed),
+        max_lag_us_(speed > 0 ? (int64_t)(AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM * 1000000.0 / (sample_rate * speed)) : 0) {}
+
+    void Reset() {
+        start_time_ = esp_timer_get_time();
+        frames_ = 0;
+    }
+
+    void Advance(int frames) {
+        if (start_time_ < 0) {
+            Reset();
+        }
+        frames_ += frames;
+        if (speed_ <= 0) {
+            return;
+        }
+        int64_t due = start_time_ + (int64_t)(frames_ * 1000000.0 / (sample_rate_ * speed_));
+        int64_t now = esp_timer_get_time();
+        if (due - now >= 1000) {
+            vTaskDelay(pdMS_TO_TICKS((due - now) / 1000));
+        } else if (now - due > max_lag_us_) {
+            // The caller stalled. Like the DMA ring of a real codec, only what the ring
+            // holds goes through without waiting, the rest of the gap is lost
+            start_time_ += now - due - max_lag_us_;
+        }
+    }
+
+private:
+    int sample_rate_;
+    float speed_;
+    // Audio the DMA ring holds, how far a stalled caller may catch up
+    int64_t max_lag_us_;
+    int64_t start_time_ = -1;
+    int64_t frames_ = 0;
+};
+
+#endif // _AUDIO_CLOCK_H
@@ -34,8 +34,13 @@ void AudioCodec::Start() {
         output_volume_ = 10;
     }
 
-    ESP_ERROR_CHECK(i2s_channel_enable(tx_handle_));
-    ESP_ERROR_CHECK(i2s_channel_enable(rx_handle_));
+    // Codecs without I2S hardware (file, loopback) leave the handles unset
+    if (tx_handle_ != nullptr) {
+        ESP_ERROR_CHECK(i2s_channel_enable(tx_handle_));
+    }
+    if (rx_handle_ != nullptr) {
+        ESP_ERROR_CHECK(i2s_channel_enable(rx_handle_));
+    }
 
     EnableInput(true);
     EnableOutput(true);
@@ -0,0 +1,175 @@
+#include "file_audio_codec.h"
+
+#include <esp_log.h>
+#include <cstring>
+
+#define TAG "FileAudioCodec"
+
+#define WAV_HEADER_SIZE 44
+
+struct WavChunkHeader {
+    char id[4];
+    uint32_t size;
+};
+
+struct WavFormat {
+    uint16_t audio_format;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+};
+
+FileAudioCodec::FileAudioCodec(const char* input_path, const char* output_path, int input_sample_rate, int output_sample_rate, float speed)
+    : input_clock_(input_sample_rate, speed), output_clock_(output_sample_rate, speed) {
+    duplex_ = true;
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+
+    if (input_path != nullptr && !OpenInput(input_path)) {
+        ESP_LOGE(TAG, "Failed to open input %s, the microphone will be silent", input_path);
+    }
+    if (output_path != nullptr && !OpenOutput(output_path)) {
+        ESP_LOGE(TAG, "Failed to open output %s", output_path);
+    }
+    input_reference_ = input_channels_ == 2;
+    ESP_LOGI(TAG, "File codec created, speed %.1fx", speed);
+}
+
+FileAudioCodec::~FileAudioCodec() {
+    if (input_file_ != nullptr) {
+        fclose(input_file_);
+    }
+    FinishOutput();
+}
+
+bool FileAudioCodec::OpenInput(const char* path) {
+    input_file_ = fopen(path, "rb");
+    if (input_file_ == nullptr) {
+        return false;
+    }
+
+    char riff[12];
+    if (fread(riff, 1, sizeof(riff), input_file_) != sizeof(riff) ||
+        memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        ESP_LOGE(TAG, "Not a WAV file: %s", path);
+        fclose(input_file_);
+        input_file_ = nullptr;
+        return false;
+    }
+
+    // Walk the chunks until the sample data, the format chunk must come first
+    bool has_format = false;
+    WavChunkHeader chunk;
+    while (fread(&chunk, 1, sizeof(chunk), input_file_) == sizeof(chunk)) {
+        if (memcmp(chunk.id, "fmt ", 4) == 0 && chunk.size >= sizeof(WavFormat)) {
+            WavFormat format;
+            if (fread(&format, 1, sizeof(format), input_file_) != sizeof(format)) {
+                break;
+            }
+            fseek(input_file_, chunk.size - sizeof(format) + (chunk.size & 1), SEEK_CUR);
+            if (format.audio_format != 1 || format.bits_per_sample != 16 ||
+                format.channels < 1 || format.channels > 2) {
+                ESP_LOGE(TAG, "Unsupported WAV format %u, %u bits, %u channels",
+                    format.audio_format, format.bits_per_sample, format.channels);
+                break;
+            }
+            if ((int)format.sample_rate != input_sample_rate_) {
+                ESP_LOGW(TAG, "WAV sample rate %lu does not match the input rate %d",
+                    format.sample_rate, input_sample_rate_);
+            }
+            input_channels_ = format.channels;
+            has_format = true;
+        } else if (memcmp(chunk.id, "data", 4) == 0 && has_format) {
+            ESP_LOGI(TAG, "Input %s: %d channel(s), %lu bytes", path, input_channels_, chunk.size);
+            return true;
+        } else {
+            fseek(input_file_, chunk.size + (chunk.size & 1), SEEK_CUR);
+        }
+    }
+
+    ESP_LOGE(TAG, "No usable audio in %s", path);
+    fclose(input_file_);
+    input_file_ = nullptr;
+    input_channels_ = 1;
+    return false;
+}
+
+bool FileAudioCodec::OpenOutput(const char* path) {
+    output_file_ = fopen(path, "wb");
+    if (output_file_ == nullptr) {
+        return false;
+    }
+    // The sizes are filled in by FinishOutput()
+    uint8_t header[WAV_HEADER_SIZE] = {};
+    fwrite(header, 1, sizeof(header), output_file_);
+    return true;
+}
+
+void FileAudioCodec::FinishOutput() {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    if (output_file_ == nullptr) {
+        return;
+    }
+
+    WavFormat format = {
+        .audio_format = 1,
+        .channels = (uint16_t)output_channels_,
+        .sample_rate = (uint32_t)output_sample_rate_,
+        .byte_rate = (uint32_t)(output_sample_rate_ * output_channels_ * sizeof(int16_t)),
+        .block_align = (uint16_t)(output_channels_ * sizeof(int16_t)),
+        .bits_per_sample = 16,
+    };
+    uint32_t riff_size = WAV_HEADER_SIZE - 8 + output_data_bytes_;
+    uint32_t format_size = sizeof(format);
+
+    fseek(output_file_, 0, SEEK_SET);
+    fwrite("RIFF", 1, 4, output_file_);
+    fwrite(&riff_size, 1, 4, output_file_);
+    fwrite("WAVEfmt ", 1, 8, output_file_);
+    fwrite(&format_size, 1, 4, output_file_);
+    fwrite(&format, 1, sizeof(format), output_file_);
+    fwrite("data", 1, 4, output_file_);
+    fwrite(&output_data_bytes_, 1, 4, output_file_);
+    fclose(output_file_);
+    output_file_ = nullptr;
+    ESP_LOGI(TAG, "Output finished, %lu bytes", output_data_bytes_);
+}
+
+void FileAudioCodec::EnableOutput(bool enable) {
+    if (enable == output_enabled_) {
+        return;
+    }
+    if (enable) {
+        output_clock_.Reset();
+    }
+    AudioCodec::EnableOutput(enable);
+}
+
+int FileAudioCodec::Read(int16_t* dest, int samples) {
+    size_t read = 0;
+    if (input_enabled_ && input_file_ != nullptr) {
+        read = fread(dest, sizeof(int16_t), samples, input_file_);
+        if (read < (size_t)samples) {
+            ESP_LOGI(TAG, "Input file ended");
+            fclose(input_file_);
+            input_file_ = nullptr;
+        }
+    }
+    memset(dest + read, 0, (samples - read) * sizeof(int16_t));
+
+    input_clock_.Advance(samples / input_channels_);
+    return samples;
+}
+
+int FileAudioCodec::Write(const int16_t* data, int samples) {
+    {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        if (output_file_ != nullptr) {
+            output_data_bytes_ += fwrite(data, sizeof(int16_t), samples, output_file_) * sizeof(int16_t);
+        }
+    }
+    output_clock_.Advance(samples / output_channels_);
+    return samples;
+}
@@ -0,0 +1,37 @@
+#ifndef _FILE_AUDIO_CODEC_H
+#define _FILE_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+#include "audio_clock.h"
+
+#include <cstdio>
+#include <mutex>
+
+// Plays a 16-bit PCM WAV file as the microphone and records the speaker
+// output to another WAV file, paced like a real codec (speed 1) or faster.
+// A stereo input file is treated as mic + AEC reference. Once the input
+// file ends the microphone returns silence. Either path may be null.
+class FileAudioCodec : public AudioCodec {
+private:
+    FILE* input_file_ = nullptr;
+    FILE* output_file_ = nullptr;
+    uint32_t output_data_bytes_ = 0;
+    AudioClock input_clock_;
+    AudioClock output_clock_;
+    std::mutex output_mutex_;
+
+    bool OpenInput(const char* path);
+    bool OpenOutput(const char* path);
+    void FinishOutput();
+
+    virtual int Read(int16_t* dest, int samples) override;
+    virtual int Write(const int16_t* data, int samples) override;
+
+public:
+    FileAudioCodec(const char* input_path, const char* output_path, int input_sample_rate, int output_sample_rate, float speed = 1.0f);
+    virtual ~FileAudioCodec();
+
+    virtual void EnableOutput(bool enable) override;
+};
+
+#endif // _FILE_AUDIO_CODEC_H
@@ -0,0 +1,61 @@
+#include "loopback_audio_codec.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "LoopbackAudioCodec"
+
+LoopbackAudioCodec::LoopbackAudioCodec(int sample_rate, int echo_delay_ms, float echo_gain, float speed)
+    : speaker_ring_(sample_rate), mic_ring_(sample_rate),
+      input_clock_(sample_rate, speed), output_clock_(sample_rate, speed),
+      echo_gain_(echo_gain), echo_line_(sample_rate * echo_delay_ms / 1000) {
+    duplex_ = true;
+    input_reference_ = true;
+    input_sample_rate_ = sample_rate;
+    output_sample_rate_ = sample_rate;
+    input_channels_ = 2;
+    ESP_LOGI(TAG, "Loopback codec created, echo %d ms x %.2f", echo_delay_ms, echo_gain);
+}
+
+LoopbackAudioCodec::~LoopbackAudioCodec() {
+}
+
+bool LoopbackAudioCodec::FeedMic(const int16_t* data, size_t samples) {
+    return mic_ring_.TryWrite(data, samples);
+}
+
+int LoopbackAudioCodec::Read(int16_t* dest, int samples) {
+    size_t frames = samples / input_channels_;
+    reference_.resize(frames);
+    near_end_.resize(frames);
+
+    // Whatever the speaker played since the last read is the reference
+    size_t count = speaker_ring_.Read(reference_.data(), frames, 0);
+    std::fill(reference_.begin() + count, reference_.end(), 0);
+    count = input_enabled_ ? mic_ring_.Read(near_end_.data(), frames, 0) : 0;
+    std::fill(near_end_.begin() + count, near_end_.end(), 0);
+
+    for (size_t i = 0; i < frames; i++) {
+        int16_t echo = reference_[i];
+        if (!echo_line_.empty()) {
+            std::swap(echo, echo_line_[echo_index_]);
+            echo_index_ = (echo_index_ + 1) % echo_line_.size();
+        }
+        int32_t mic = near_end_[i] + (int32_t)(echo * echo_gain_);
+        dest[i * 2] = (int16_t)std::clamp<int32_t>(mic, INT16_MIN, INT16_MAX);
+        dest[i * 2 + 1] = reference_[i];
+    }
+
+    input_clock_.Advance(frames);
+    return samples;
+}
+
+int LoopbackAudioCodec::Write(const int16_t* data, int samples) {
+    if (!speaker_ring_.TryWrite(data, samples)) {
+        // Nobody is reading the input, the reference would only go stale
+        speaker_ring_.Clear();
+    }
+    output_clock_.Advance(samples);
+    return samples;
+}
@@ -0,0 +1,36 @@
+#ifndef _LOOPBACK_AUDIO_CODEC_H
+#define _LOOPBACK_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+#include "audio_clock.h"
+#include "pcm_ring.h"
+
+// Routes the speaker output back into the input as the AEC reference channel.
+// The microphone channel carries whatever FeedMic() queued plus an attenuated,
+// delayed copy of the speaker, so echo cancellation sees a realistic echo.
+// Input is stereo (mic + reference) at the same rate as the output.
+class LoopbackAudioCodec : public AudioCodec {
+private:
+    PcmRing speaker_ring_;
+    PcmRing mic_ring_;
+    AudioClock input_clock_;
+    AudioClock output_clock_;
+    float echo_gain_;
+    // Touched by Read() only
+    std::vector<int16_t> echo_line_;
+    size_t echo_index_ = 0;
+    std::vector<int16_t> reference_;
+    std::vector<int16_t> near_end_;
+
+    virtual int Read(int16_t* dest, int samples) override;
+    virtual int Write(const int16_t* data, int samples) override;
+
+public:
+    LoopbackAudioCodec(int sample_rate, int echo_delay_ms = 20, float echo_gain = 0.5f, float speed = 1.0f);
+    virtual ~LoopbackAudioCodec();
+
+    // Queue near-end speech for the microphone channel, dropped if more than a second is pending
+    bool FeedMic(const int16_t* data, size_t samples);
+};
+
+#endif // _LOOPBACK_AUDIO_CODEC_H
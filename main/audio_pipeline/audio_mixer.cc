@@ -0,0 +1,119 @@
+#include "audio_mixer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+static inline int32_t ToQ15(float gain) {
+    return (int32_t)(std::clamp(gain, 0.0f, 1.0f) * (1 << 15));
+}
+
+AudioMixer::AudioMixer(int voices, size_t samples_per_voice) : voices_(voices) {
+    for (auto& voice : voices_) {
+        voice.ring = std::make_unique<PcmRing>(samples_per_voice);
+        // Runs with the ring locked, Mix() never reads a ring while holding wait_mutex_
+        voice.ring->OnData([this]() { Notify(false); });
+    }
+}
+
+void AudioMixer::SetGain(int index, float gain) {
+    voices_[index].gain = ToQ15(gain);
+}
+
+void AudioMixer::SetDucking(int index, float duck_gain) {
+    voices_[index].duck_gain = ToQ15(duck_gain);
+}
+
+size_t AudioMixer::Mix(int16_t* output, size_t max_samples, int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    size_t mixed = 0;
+    while (true) {
+        uint32_t events;
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+            events = events_;
+        }
+        for (auto& voice : voices_) {
+            voice.buffer.resize(max_samples);
+            voice.samples = voice.ring->Read(voice.buffer.data(), max_samples, 0);
+            mixed = std::max(mixed, voice.samples);
+        }
+        if (mixed > 0) {
+            break;
+        }
+
+        // Samples queued after the reads above have bumped events_, so they are not missed
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        if (wake_) {
+            wake_ = false;
+            return 0;
+        }
+        if (!wait_cv_.wait_until(lock, deadline, [this, events]() { return events_ != events; })) {
+            return 0;
+        }
+    }
+
+    int32_t duck = 1 << 15;
+    for (auto& voice : voices_) {
+        if (voice.samples > 0 && voice.duck_gain >= 0) {
+            duck = std::min(duck, voice.duck_gain);
+        }
+    }
+
+    accumulator_.assign(mixed, 0);
+    for (auto& voice : voices_) {
+        int32_t target = voice.duck_gain >= 0 ? voice.gain : (int32_t)(((int64_t)voice.gain * duck) >> 15);
+        int32_t start = voice.applied_gain;
+        voice.applied_gain = target;
+        if (voice.samples == 0) {
+            continue;
+        }
+
+        const int16_t* in = voice.buffer.data();
+        int32_t* acc = accumulator_.data();
+        if (start == target) {
+            for (size_t i = 0; i < voice.samples; i++) {
+                acc[i] += (in[i] * target) >> 15;
+            }
+        } else {
+            // Linear ramp from the previous gain across this chunk
+            int32_t step = (target - start) / (int32_t)voice.samples;
+            int32_t gain = start;
+            for (size_t i = 0; i < voice.samples; i++) {
+                acc[i] += (in[i] * gain) >> 15;
+                gain += step;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < mixed; i++) {
+        output[i] = (int16_t)std::clamp<int32_t>(accumulator_[i], INT16_MIN, INT16_MAX);
+    }
+    return mixed;
+}
+
+void AudioMixer::Wake() {
+    Notify(true);
+}
+
+void AudioMixer::Notify(bool wake) {
+    std::lock_guard<std::mutex> lock(wait_mutex_);
+    events_++;
+    wake_ = wake_ || wake;
+    wait_cv_.notify_all();
+}
+
+bool AudioMixer::Empty() const {
+    for (auto& voice : voices_) {
+        if (!voice.ring->Empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AudioMixer::Clear() {
+    for (auto& voice : voices_) {
+        voice.ring->Clear();
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "pcm_ring.h"
+
+// Sums several mono PCM voices into one output stream. Each voice is a PcmRing
+// filled by its own producer, with its own gain. A voice can duck the others
+// while it has audio, e.g. a notification over speech. Gain changes ramp over
+// one mix chunk to avoid clicks, and the sum saturates instead of wrapping.
+class AudioMixer {
+public:
+    AudioMixer(int voices, size_t samples_per_voice);
+
+    inline PcmRing& voice(int index) { return *voices_[index].ring; }
+    void SetGain(int index, float gain);
+    // While this voice is playing the other voices are scaled by duck_gain
+    void SetDucking(int index, float duck_gain);
+
+    // Mix up to max_samples into output. Waits up to timeout_ms if every voice
+    // is empty and returns the number of samples written, 0 on timeout or Wake().
+    size_t Mix(int16_t* output, size_t max_samples, int timeout_ms);
+    // Makes a Mix() waiting on empty voices return early
+    void Wake();
+    bool Empty() const;
+    void Clear();
+
+private:
+    struct Voice {
+        std::unique_ptr<PcmRing> ring;
+        std::vector<int16_t> buffer;
+        int32_t gain = 1 << 15;          // Q15
+        int32_t applied_gain = 1 << 15;  // Q15, after ducking, ramps towards the target
+        int32_t duck_gain = -1;          // Q15, -1 if this voice does not duck
+        size_t samples = 0;
+    };
+    std::vector<Voice> voices_;
+    std::vector<int32_t> accumulator_;
+    // Bumped whenever any voice gets samples, Mix() sleeps until it changes
+    std::mutex wait_mutex_;
+    std::condition_variable wait_cv_;
+    uint32_t events_ = 0;
+    bool wake_ = false;
+
+    void Notify(bool wake);
+};
+
+#endif // AUDIO_MIXER_H
@@ -0,0 +1,167 @@
+#include "audio_packet_ring.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+#include <chrono>
+
+#define TAG "AudioPacketRing"
+
+AudioPacketRing::AudioPacketRing(size_t capacity, size_t max_packet_size, bool prefer_psram)
+    : capacity_(capacity), max_packet_size_(max_packet_size) {
+    // Slot layout: packet data, then timestamps, then sizes
+    max_packet_size_ = (max_packet_size_ + 7) & ~7;
+    size_t slab_size = capacity_ * (max_packet_size_ + sizeof(int64_t) + sizeof(uint16_t));
+    if (prefer_psram) {
+        slab_ = (uint8_t*)heap_caps_malloc(slab_size, MALLOC_CAP_SPIRAM);
+    }
+    if (slab_ == nullptr) {
+        slab_ = (uint8_t*)heap_caps_malloc(slab_size, MALLOC_CAP_8BIT);
+    }
+    if (slab_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %zu bytes for %zu packets", slab_size, capacity_);
+        capacity_ = 0;
+        return;
+    }
+    timestamps_ = (int64_t*)(slab_ + capacity_ * max_packet_size_);
+    sizes_ = (uint16_t*)(timestamps_ + capacity_);
+    ESP_LOGI(TAG, "Allocated %zu packets x %zu bytes", capacity_, max_packet_size_);
+}
+
+AudioPacketRing::~AudioPacketRing() {
+    if (slab_ != nullptr) {
+        heap_caps_free(slab_);
+    }
+}
+
+uint32_t AudioPacketRing::ReadIndex() const {
+    uint32_t tail = tail_.load(std::memory_order_acquire);
+    uint32_t flush = flush_.load(std::memory_order_acquire);
+    return (int32_t)(flush - tail) > 0 ? flush : tail;
+}
+
+bool AudioPacketRing::HasSpace() const {
+    // Flushed slots are free unless the consumer may be copying one of them.
+    // flush_ is loaded before reading_: a Pop that starts after reading_ was
+    // seen clear reads at or past that flush counter, so it never lands on
+    // the slot a producer is about to fill.
+    uint32_t head = head_.load(std::memory_order_acquire);
+    uint32_t flush = flush_.load();
+    uint32_t base = tail_.load();
+    if (!reading_.load() && (int32_t)(flush - base) > 0) {
+        base = flush;
+    }
+    return head - base < capacity_;
+}
+
+size_t AudioPacketRing::Size() const {
+    uint32_t head = head_.load(std::memory_order_acquire);
+    return head - ReadIndex();
+}
+
+bool AudioPacketRing::Push(const uint8_t* data, size_t size, bool wait, int64_t timestamp) {
+    if (size > max_packet_size_) {
+        ESP_LOGW(TAG, "Packet too large: %zu > %zu", size, max_packet_size_);
+        return false;
+    }
+
+    while (true) {
+        bool full = false;
+        {
+            std::lock_guard<std::mutex> lock(producer_mutex_);
+            uint32_t head = head_.load(std::memory_order_relaxed);
+            if (HasSpace()) {
+                size_t index = head % capacity_;
+                if (size > 0) {
+                    memcpy(slab_ + index * max_packet_size_, data, size);
+                }
+                sizes_[index] = size;
+                timestamps_[index] = timestamp;
+                head_.store(head + 1);
+            } else {
+                full = true;
+            }
+        }
+        if (!full) {
+            NotifyWaiters();
+            return true;
+        }
+        if (!wait || capacity_ == 0) {
+            return false;
+        }
+
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        waiters_++;
+        wait_cv_.wait(lock, [this]() {
+            return HasSpace();
+        });
+        waiters_--;
+    }
+}
+
+bool AudioPacketRing::Pop(std::vector<uint8_t>& packet, int64_t* timestamp) {
+    // Announce the read before picking the slot, see HasSpace()
+    reading_.store(true);
+    uint32_t tail = ReadIndex();
+    if (tail == head_.load(std::memory_order_acquire)) {
+        tail_.store(tail);
+        reading_.store(false);
+        NotifyWaiters();
+        return false;
+    }
+
+    size_t index = tail % capacity_;
+    const uint8_t* data = slab_ + index * max_packet_size_;
+    packet.assign(data, data + sizes_[index]);
+    if (timestamp != nullptr) {
+        *timestamp = timestamps_[index];
+    }
+    tail_.store(tail + 1);
+    reading_.store(false);
+    NotifyWaiters();
+    return true;
+}
+
+bool AudioPacketRing::Pop(std::vector<uint8_t>& packet, int timeout_ms, int64_t* timestamp) {
+    if (Pop(packet, timestamp)) {
+        return true;
+    }
+    Wait(timeout_ms);
+    return Pop(packet, timestamp);
+}
+
+bool AudioPacketRing::Wait(int timeout_ms) {
+    if (!Empty()) {
+        return true;
+    }
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    waiters_++;
+    bool ready = wait_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() {
+        return !Empty();
+    });
+    waiters_--;
+    return ready;
+}
+
+void AudioPacketRing::Clear() {
+    flush_.store(head_.load());
+    NotifyWaiters();
+}
+
+void AudioPacketRing::WaitUntilEmpty() {
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    waiters_++;
+    wait_cv_.wait(lock, [this]() {
+        return Empty();
+    });
+    waiters_--;
+}
+
+void AudioPacketRing::NotifyWaiters() {
+    // Waiters register before checking their predicate, so taking the lock
+    // here is only needed when somebody is actually waiting
+    if (waiters_.load() > 0) {
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        wait_cv_.notify_all();
+    }
+}
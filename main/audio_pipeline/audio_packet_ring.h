@@ -0,0 +1,68 @@
+#ifndef AUDIO_PACKET_RING_H
+#define AUDIO_PACKET_RING_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+// Fixed-capacity packet queue for Opus streams in either direction.
+// All slots live in one slab allocated up front (in PSRAM when available),
+// so Push and Pop never touch the heap. The consumer side is lock-free;
+// producers (e.g. network callback and PlaySound) are serialized by a lock that
+// the consumer never takes.
+class AudioPacketRing {
+public:
+    AudioPacketRing(size_t capacity, size_t max_packet_size, bool prefer_psram = true);
+    ~AudioPacketRing();
+
+    AudioPacketRing(const AudioPacketRing&) = delete;
+    AudioPacketRing& operator=(const AudioPacketRing&) = delete;
+
+    // Copy a packet into the next free slot. When wait is false the packet
+    // is dropped if the ring is full, otherwise the caller blocks for space.
+    // The timestamp is opaque and handed back by Pop.
+    bool Push(const uint8_t* data, size_t size, bool wait = false, int64_t timestamp = 0);
+    // Consumer only
+    bool Pop(std::vector<uint8_t>& packet, int64_t* timestamp = nullptr);
+    bool Pop(std::vector<uint8_t>& packet, int timeout_ms, int64_t* timestamp = nullptr);
+    // Consumer only, waits up to timeout_ms for a packet without taking it
+    bool Wait(int timeout_ms);
+    // Drop all queued packets, safe to call from any task. The slots are free
+    // for Push right away, also while the consumer is idle.
+    void Clear();
+    void WaitUntilEmpty();
+
+    size_t Size() const;
+    inline bool Empty() const { return Size() == 0; }
+    inline size_t capacity() const { return capacity_; }
+    inline size_t max_packet_size() const { return max_packet_size_; }
+
+private:
+    size_t capacity_;
+    size_t max_packet_size_;
+    uint8_t* slab_ = nullptr;
+    int64_t* timestamps_ = nullptr;
+    uint16_t* sizes_ = nullptr;
+
+    // Monotonic counters, the slot index is counter % capacity_
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    // Packets before this counter were discarded by Clear()
+    std::atomic<uint32_t> flush_{0};
+    // Set while Pop copies a slot, producers then only reuse slots before tail_
+    std::atomic<bool> reading_{false};
+
+    std::mutex producer_mutex_;
+    std::mutex wait_mutex_;
+    std::condition_variable wait_cv_;
+    std::atomic<int> waiters_{0};
+
+    uint32_t ReadIndex() const;
+    bool HasSpace() const;
+    void NotifyWaiters();
+};
+
+#endif // AUDIO_PACKET_RING_H
@@ -0,0 +1,60 @@
+#include "audio_resampler.h"
+
+#include <esp_log.h>
+
+#define TAG "AudioResampler"
+
+static std::unique_ptr<FixedRatioResampler> CreateFixedRatioResampler(int input_sample_rate, int output_sample_rate) {
+    // Microphone to 16k for AFE and Opus
+    if (input_sample_rate == 24000 && output_sample_rate == 16000) {
+        return std::make_unique<PolyphaseResampler<2, 3, 48>>();
+    }
+    if (input_sample_rate == 48000 && output_sample_rate == 16000) {
+        return std::make_unique<PolyphaseResampler<1, 3, 96>>();
+    }
+    // Decoder output to the speaker
+    if (input_sample_rate == 16000 && output_sample_rate == 24000) {
+        return std::make_unique<PolyphaseResampler<3, 2, 32>>();
+    }
+    if (input_sample_rate == 24000 && output_sample_rate == 48000) {
+        return std::make_unique<PolyphaseResampler<2, 1, 32>>();
+    }
+    if (input_sample_rate == 16000 && output_sample_rate == 48000) {
+        return std::make_unique<PolyphaseResampler<3, 1, 32>>();
+    }
+    return nullptr;
+}
+
+void AudioResampler::Configure(int input_sample_rate, int output_sample_rate) {
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    fixed_ = CreateFixedRatioResampler(input_sample_rate, output_sample_rate);
+    if (fixed_) {
+        ESP_LOGI(TAG, "Polyphase resampler %d -> %d", input_sample_rate, output_sample_rate);
+    } else {
+        fallback_.Configure(input_sample_rate, output_sample_rate);
+    }
+}
+
+void AudioResampler::Reset() {
+    if (fixed_) {
+        fixed_->Reset();
+    } else if (input_sample_rate_ != 0) {
+        fallback_.Configure(input_sample_rate_, output_sample_rate_);
+    }
+}
+
+void AudioResampler::Process(const int16_t* input, int input_samples, int16_t* output) {
+    if (fixed_) {
+        fixed_->Process(input, input_samples, output);
+    } else {
+        fallback_.Process(input, input_samples, output);
+    }
+}
+
+int AudioResampler::GetOutputSamples(int input_samples) const {
+    if (fixed_) {
+        return fixed_->GetOutputSamples(input_samples);
+    }
+    return fallback_.GetOutputSamples(input_samples);
+}
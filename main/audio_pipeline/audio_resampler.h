@@ -0,0 +1,29 @@
+#ifndef AUDIO_RESAMPLER_H
+#define AUDIO_RESAMPLER_H
+
+#include <memory>
+#include <opus_resampler.h>
+
+#include "polyphase_resampler.h"
+
+// Drop-in replacement for OpusResampler. The rate pairs this firmware uses
+// run on a specialized PolyphaseResampler, anything else goes to OpusResampler.
+class AudioResampler {
+public:
+    void Configure(int input_sample_rate, int output_sample_rate);
+    // Forget the filter history, e.g. between unrelated clips
+    void Reset();
+    void Process(const int16_t* input, int input_samples, int16_t* output);
+    int GetOutputSamples(int input_samples) const;
+
+    inline int input_sample_rate() const { return input_sample_rate_; }
+    inline int output_sample_rate() const { return output_sample_rate_; }
+
+private:
+    int input_sample_rate_ = 0;
+    int output_sample_rate_ = 0;
+    std::unique_ptr<FixedRatioResampler> fixed_;
+    OpusResampler fallback_;
+};
+
+#endif // AUDIO_RESAMPLER_H
@@ -0,0 +1,95 @@
+#include "codec_benchmark.h"
+#include "latency_stats.h"
+
+#include <opus_encoder.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+
+#define TAG "CodecBenchmark"
+
+#define BENCHMARK_DURATION_MS 3000
+// Per packet: IPv4 + UDP headers and the 16 byte nonce of the MQTT+UDP transport
+#define BENCHMARK_PACKET_OVERHEAD_BYTES (20 + 8 + 16)
+// Opus encoder lookahead at the default application setting
+#define OPUS_LOOKAHEAD_US 2500
+
+// Voiced-speech stand-in: a 150 Hz harmonic series with a slow syllable envelope plus noise
+static void GenerateSpeechLike(std::vector<int16_t>& pcm, int sample_rate, int offset) {
+    for (size_t i = 0; i < pcm.size(); i++) {
+        float t = (float)(offset + i) / sample_rate;
+        float envelope = 0.5f + 0.5f * sinf(2 * M_PI * 4 * t);
+        float value = 0;
+        for (int harmonic = 1; harmonic <= 8; harmonic++) {
+            value += sinf(2 * M_PI * 150 * harmonic * t) / harmonic;
+        }
+        value = value * envelope * 6000 + (rand() % 1000 - 500);
+        pcm[i] = (int16_t)value;
+    }
+}
+
+void RunOpusEncodeBenchmark(int sample_rate, int frame_duration_ms) {
+    const int frame_samples = sample_rate * frame_duration_ms / 1000;
+    const int frames = BENCHMARK_DURATION_MS / frame_duration_ms;
+    std::vector<std::vector<int16_t>> input(frames, std::vector<int16_t>(frame_samples));
+    for (int i = 0; i < frames; i++) {
+        GenerateSpeechLike(input[i], sample_rate, i * frame_samples);
+    }
+
+    // Complexities picked in Application::Start: realtime chat, WiFi boards, ML307 boards
+    const int complexities[] = {0, 3, 5};
+    for (int complexity : complexities) {
+        OpusEncoderWrapper encoder(sample_rate, 1, frame_duration_ms);
+        encoder.SetComplexity(complexity);
+        LatencyStats stats;
+        size_t bytes = 0;
+        for (int i = 0; i < frames; i++) {
+            std::vector<int16_t> pcm = input[i];
+            int64_t start = esp_timer_get_time();
+            encoder.Encode(std::move(pcm), [&bytes](std::vector<uint8_t>&& opus) {
+                bytes += opus.size();
+            });
+            stats.Add(esp_timer_get_time() - start);
+        }
+        char name[48];
+        snprintf(name, sizeof(name), "Opus encode %dms complexity %d", frame_duration_ms, complexity);
+        stats.Log(TAG, name);
+        ESP_LOGI(TAG, "Complexity %d: %.1f%% of real time, %u bytes/frame", complexity,
+            stats.average_us() / (frame_duration_ms * 10.0), (unsigned)(bytes / frames));
+    }
+}
+
+void RunOpusFrameDurationBenchmark(int sample_rate, int complexity) {
+    std::vector<int16_t> input(sample_rate * BENCHMARK_DURATION_MS / 1000);
+    GenerateSpeechLike(input, sample_rate, 0);
+
+    const int durations[] = {20, 40, 60};
+    for (int frame_duration_ms : durations) {
+        const size_t frame_samples = sample_rate * frame_duration_ms / 1000;
+        const int frames = input.size() / frame_samples;
+        OpusEncoderWrapper encoder(sample_rate, 1, frame_duration_ms);
+        encoder.SetComplexity(complexity);
+        LatencyStats stats;
+        size_t bytes = 0;
+        for (int i = 0; i < frames; i++) {
+            std::vector<int16_t> pcm(input.begin() + i * frame_samples, input.begin() + (i + 1) * frame_samples);
+            int64_t start = esp_timer_get_time();
+            encoder.Encode(std::move(pcm), [&bytes](std::vector<uint8_t>&& opus) {
+                bytes += opus.size();
+            });
+            stats.Add(esp_timer_get_time() - start);
+        }
+
+        // A frame can only be encoded once its last sample was captured, so the
+        // earliest sample waits a whole frame plus the lookahead and encode time
+        int64_t latency_us = frame_duration_ms * 1000 + OPUS_LOOKAHEAD_US + stats.average_us();
+        float payload_kbps = bytes * 8.0f / BENCHMARK_DURATION_MS;
+        float wire_kbps = (bytes + (size_t)frames * BENCHMARK_PACKET_OVERHEAD_BYTES) * 8.0f / BENCHMARK_DURATION_MS;
+        ESP_LOGI(TAG, "Opus %dms complexity %d: latency %lld ms, %.1f%% of real time, %.1f kbps payload, %.1f kbps on the wire, %d packets/s",
+            frame_duration_ms, complexity, latency_us / 1000, stats.average_us() / (frame_duration_ms * 10.0),
+            payload_kbps, wire_kbps, 1000 / frame_duration_ms);
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef CODEC_BENCHMARK_H
+#define CODEC_BENCHMARK_H
+
+// Encodes a few seconds of synthetic speech-like audio at every Opus complexity
+// the application uses and logs the CPU time per frame. Runs on the calling task.
+void RunOpusEncodeBenchmark(int sample_rate, int frame_duration_ms);
+// Encodes the same audio with 20, 40 and 60 ms frames and logs the latency a frame
+// adds, the CPU time and the bandwidth including per-packet transport overhead.
+void RunOpusFrameDurationBenchmark(int sample_rate, int complexity);
+
+#endif // CODEC_BENCHMARK_H
@@ -0,0 +1,41 @@
+#include "endpointer.h"
+
+Endpointer::Endpointer(int sample_rate, int trailing_silence_ms, int min_speech_ms)
+    : trailing_silence_samples_((size_t)sample_rate * trailing_silence_ms / 1000),
+      min_speech_samples_((size_t)sample_rate * min_speech_ms / 1000) {
+}
+
+void Endpointer::SetSpeaking(bool speaking) {
+    speaking_ = speaking;
+    if (speaking) {
+        silence_samples_ = 0;
+    }
+}
+
+bool Endpointer::Process(size_t samples) {
+    if (ended_) {
+        return false;
+    }
+    if (speaking_) {
+        speech_samples_ += samples;
+        return false;
+    }
+
+    // Silence before the first word never ends the utterance
+    if (speech_samples_ < min_speech_samples_ || speech_samples_ == 0) {
+        return false;
+    }
+    silence_samples_ += samples;
+    if (silence_samples_ >= trailing_silence_samples_) {
+        ended_ = true;
+        return true;
+    }
+    return false;
+}
+
+void Endpointer::Reset() {
+    speaking_ = false;
+    ended_ = false;
+    speech_samples_ = 0;
+    silence_samples_ = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef ENDPOINTER_H
+#define ENDPOINTER_H
+
+#include <cstddef>
+
+// Local end-of-utterance detection from VAD edges. The utterance ends once
+// at least min_speech_ms of speech was heard in total and the VAD has then
+// reported silence for trailing_silence_ms, pauses shorter than that keep
+// the utterance going. Audio is counted in samples so the timing follows
+// the capture clock rather than task scheduling.
+// Not thread safe, fed from the capture task together with the VAD events.
+class Endpointer {
+public:
+    Endpointer(int sample_rate, int trailing_silence_ms, int min_speech_ms);
+
+    void SetSpeaking(bool speaking);
+    // Accounts for captured audio, true exactly once when the utterance ends
+    bool Process(size_t samples);
+    void Reset();
+
+    inline bool ended() const { return ended_; }
+    // Length of the trailing silence that confirmed the end, in samples
+    inline size_t trailing_samples() const { return trailing_silence_samples_; }
+
+private:
+    size_t trailing_silence_samples_;
+    size_t min_speech_samples_;
+
+    bool speaking_ = false;
+    bool ended_ = false;
+    size_t speech_samples_ = 0;
+    size_t silence_samples_ = 0;
+};
+
+#endif // ENDPOINTER_H
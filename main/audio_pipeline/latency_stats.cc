@@ -0,0 +1,61 @@
+#include "latency_stats.h"
+
+#include <esp_log.h>
+#include <cstring>
+
+int LatencyStats::BucketOf(int64_t us) {
+    if (us < 8) {
+        return us < 0 ? 0 : us;
+    }
+    int msb = 63 - __builtin_clzll(us);
+    int bucket = (msb - 2) * 8 + ((us >> (msb - 3)) & 7);
+    return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+int64_t LatencyStats::BucketValue(int bucket) {
+    if (bucket < 8) {
+        return bucket;
+    }
+    int shift = bucket / 8 - 1;
+    int64_t lower = (int64_t)(8 + bucket % 8) << shift;
+    // Middle of the bucket
+    return lower + ((1LL << shift) >> 1);
+}
+
+void LatencyStats::Add(int64_t us) {
+    count_++;
+    sum_us_ += us;
+    if (us > max_us_) {
+        max_us_ = us;
+    }
+    buckets_[BucketOf(us)]++;
+}
+
+void LatencyStats::Reset() {
+    count_ = 0;
+    sum_us_ = 0;
+    max_us_ = 0;
+    memset(buckets_, 0, sizeof(buckets_));
+}
+
+int64_t LatencyStats::Percentile(int percent) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    uint32_t rank = ((uint64_t)count_ * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < kBuckets; i++) {
+        seen += buckets_[i];
+        if (seen >= rank && seen > 0) {
+            int64_t value = BucketValue(i);
+            return value < max_us_ ? value : max_us_;
+        }
+    }
+    return max_us_;
+}
+
+void LatencyStats::Log(const char* tag, const char* name) const {
+    ESP_LOGI(tag, "%s n=%lu avg=%.1f p50=%.1f p95=%.1f p99=%.1f max=%.1f ms", name, count_,
+        average_us() / 1000.0, Percentile(50) / 1000.0, Percentile(95) / 1000.0,
+        Percentile(99) / 1000.0, max_us_ / 1000.0);
+}
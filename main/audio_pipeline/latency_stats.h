@@ -0,0 +1,36 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <cstdint>
+
+// Latency distribution in microseconds: count, average, max and percentiles.
+// Samples go into log-linear buckets (8 per power of two, so within ~6%),
+// which keeps the footprint fixed no matter how many samples are added.
+// Not thread safe, each pipeline stage owns its own instance.
+class LatencyStats {
+public:
+    void Add(int64_t us);
+    void Reset();
+    // Approximate value below which `percent` of the samples fall
+    int64_t Percentile(int percent) const;
+    // One line: name n=.. avg=.. p50=.. p95=.. p99=.. max=.. (ms)
+    void Log(const char* tag, const char* name) const;
+
+    inline uint32_t count() const { return count_; }
+    inline int64_t average_us() const { return count_ > 0 ? sum_us_ / count_ : 0; }
+    inline int64_t max_us() const { return max_us_; }
+
+private:
+    // Values up to 2^24 us (~16 s), larger ones land in the last bucket
+    static constexpr int kBuckets = (24 - 2) * 8 + 8;
+
+    uint32_t count_ = 0;
+    int64_t sum_us_ = 0;
+    int64_t max_us_ = 0;
+    uint32_t buckets_[kBuckets] = {};
+
+    static int BucketOf(int64_t us);
+    static int64_t BucketValue(int bucket);
+};
+
+#endif // LATENCY_STATS_H
@@ -0,0 +1,42 @@
+#include "opus_packet_decoder.h"
+
+#include <opus.h>
+#include <esp_log.h>
+
+#define TAG "OpusPacketDecoder"
+
+OpusPacketDecoder::OpusPacketDecoder(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), channels_(channels), frame_size_(sample_rate / 1000 * duration_ms) {
+    int error;
+    decoder_ = opus_decoder_create(sample_rate, channels, &error);
+    if (decoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio decoder, error code: %d", error);
+    }
+}
+
+OpusPacketDecoder::~OpusPacketDecoder() {
+    if (decoder_ != nullptr) {
+        opus_decoder_destroy(decoder_);
+    }
+}
+
+bool OpusPacketDecoder::Decode(const uint8_t* data, size_t size, std::vector<int16_t>& pcm) {
+    if (decoder_ == nullptr) {
+        return false;
+    }
+    pcm.resize(frame_size_ * channels_);
+    int samples = opus_decode(decoder_, data, size, pcm.data(), frame_size_, 0);
+    if (samples < 0) {
+        ESP_LOGE(TAG, "Failed to decode audio, error code: %d", samples);
+        pcm.clear();
+        return false;
+    }
+    pcm.resize(samples * channels_);
+    return true;
+}
+
+void OpusPacketDecoder::ResetState() {
+    if (decoder_ != nullptr) {
+        opus_decoder_ctl(decoder_, OPUS_RESET_STATE);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef OPUS_PACKET_DECODER_H
+#define OPUS_PACKET_DECODER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+struct OpusDecoder;
+
+// Opus decoder that reads packets from caller-owned memory, e.g. assets mapped
+// from flash. OpusDecoderWrapper takes a std::vector by rvalue, which forces a
+// copy (and usually an allocation) for every packet that is not already in one.
+class OpusPacketDecoder {
+public:
+    OpusPacketDecoder(int sample_rate, int channels, int duration_ms);
+    ~OpusPacketDecoder();
+
+    OpusPacketDecoder(const OpusPacketDecoder&) = delete;
+    OpusPacketDecoder& operator=(const OpusPacketDecoder&) = delete;
+
+    // pcm keeps its capacity between calls
+    bool Decode(const uint8_t* data, size_t size, std::vector<int16_t>& pcm);
+    void ResetState();
+
+    inline int sample_rate() const { return sample_rate_; }
+
+private:
+    OpusDecoder* decoder_ = nullptr;
+    int sample_rate_;
+    int channels_;
+    int frame_size_;
+};
+
+#endif // OPUS_PACKET_DECODER_H
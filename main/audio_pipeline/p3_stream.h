@@ -0,0 +1,52 @@
+#ifndef P3_STREAM_H
+#define P3_STREAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <arpa/inet.h>
+
+#include "protocol.h"
+
+// Walks the Opus packets of a P3 asset in place. Works on any mapped memory,
+// embedded rodata today or an mmap'ed assets partition, and never copies:
+// Next() hands out pointers into the asset itself.
+class P3Stream {
+public:
+    explicit P3Stream(std::string_view asset) : asset_(asset) {}
+
+    // False at the end of the asset or at a truncated packet
+    bool Next(const uint8_t*& payload, size_t& size) {
+        if (offset_ + sizeof(BinaryProtocol3) > asset_.size()) {
+            return false;
+        }
+        auto p3 = (const BinaryProtocol3*)(asset_.data() + offset_);
+        size_t payload_size = ntohs(p3->payload_size);
+        if (offset_ + sizeof(BinaryProtocol3) + payload_size > asset_.size()) {
+            return false;
+        }
+        payload = p3->payload;
+        size = payload_size;
+        offset_ += sizeof(BinaryProtocol3) + payload_size;
+        return true;
+    }
+
+    size_t CountPackets() const {
+        P3Stream stream(asset_);
+        const uint8_t* payload;
+        size_t size;
+        size_t count = 0;
+        while (stream.Next(payload, size)) {
+            count++;
+        }
+        return count;
+    }
+
+    inline void Rewind() { offset_ = 0; }
+
+private:
+    std::string_view asset_;
+    size_t offset_ = 0;
+};
+
+#endif // P3_STREAM_H
@@ -0,0 +1,152 @@
+#include "pcm_interleave.h"
+
+#include <cstring>
+
+// The 32-bit kernels pack two samples per word, low half first (little endian).
+// Words alias the int16_t buffers, so tell the compiler.
+typedef uint32_t __attribute__((__may_alias__)) pcm_word_t;
+
+static inline bool IsWordAligned(const void* p) {
+    return ((uintptr_t)p & 3) == 0;
+}
+
+static void DeinterleaveStereo(const int16_t* input, int16_t* left, int16_t* right, size_t frames) {
+    size_t i = 0;
+    if (IsWordAligned(input) && IsWordAligned(left) && IsWordAligned(right)) {
+        auto in = (const pcm_word_t*)__builtin_assume_aligned(input, 4);
+        auto l = (pcm_word_t*)__builtin_assume_aligned(left, 4);
+        auto r = (pcm_word_t*)__builtin_assume_aligned(right, 4);
+        // 4 frames per iteration: 4 loads and 4 stores instead of 8 + 8 halfword accesses
+        for (; i + 4 <= frames; i += 4) {
+            uint32_t w0 = in[0], w1 = in[1], w2 = in[2], w3 = in[3];
+            l[0] = (w0 & 0xFFFF) | (w1 << 16);
+            r[0] = (w0 >> 16) | (w1 & 0xFFFF0000);
+            l[1] = (w2 & 0xFFFF) | (w3 << 16);
+            r[1] = (w2 >> 16) | (w3 & 0xFFFF0000);
+            in += 4;
+            l += 2;
+            r += 2;
+        }
+    }
+    for (; i < frames; i++) {
+        left[i] = input[i * 2];
+        right[i] = input[i * 2 + 1];
+    }
+}
+
+static void InterleaveStereo(const int16_t* left, const int16_t* right, int16_t* output, size_t frames) {
+    size_t i = 0;
+    if (IsWordAligned(output) && IsWordAligned(left) && IsWordAligned(right)) {
+        auto l = (const pcm_word_t*)__builtin_assume_aligned(left, 4);
+        auto r = (const pcm_word_t*)__builtin_assume_aligned(right, 4);
+        auto out = (pcm_word_t*)__builtin_assume_aligned(output, 4);
+        for (; i + 4 <= frames; i += 4) {
+            uint32_t l0 = l[0], r0 = r[0], l1 = l[1], r1 = r[1];
+            out[0] = (l0 & 0xFFFF) | (r0 << 16);
+            out[1] = (l0 >> 16) | (r0 & 0xFFFF0000);
+            out[2] = (l1 & 0xFFFF) | (r1 << 16);
+            out[3] = (l1 >> 16) | (r1 & 0xFFFF0000);
+            l += 2;
+            r += 2;
+            out += 4;
+        }
+    }
+    for (; i < frames; i++) {
+        output[i * 2] = left[i];
+        output[i * 2 + 1] = right[i];
+    }
+}
+
+static void DeinterleaveQuad(const int16_t* input, int16_t* const* outputs, size_t frames) {
+    int16_t* c0 = outputs[0];
+    int16_t* c1 = outputs[1];
+    int16_t* c2 = outputs[2];
+    int16_t* c3 = outputs[3];
+    size_t i = 0;
+    if (IsWordAligned(input) && IsWordAligned(c0) && IsWordAligned(c1) && IsWordAligned(c2) && IsWordAligned(c3)) {
+        auto in = (const pcm_word_t*)__builtin_assume_aligned(input, 4);
+        // 2 frames per iteration: each input word holds a channel pair of one frame
+        for (; i + 2 <= frames; i += 2) {
+            uint32_t a0 = in[0], b0 = in[1], a1 = in[2], b1 = in[3];
+            *(pcm_word_t*)(c0 + i) = (a0 & 0xFFFF) | (a1 << 16);
+            *(pcm_word_t*)(c1 + i) = (a0 >> 16) | (a1 & 0xFFFF0000);
+            *(pcm_word_t*)(c2 + i) = (b0 & 0xFFFF) | (b1 << 16);
+            *(pcm_word_t*)(c3 + i) = (b0 >> 16) | (b1 & 0xFFFF0000);
+            in += 4;
+        }
+    }
+    for (; i < frames; i++) {
+        c0[i] = input[i * 4];
+        c1[i] = input[i * 4 + 1];
+        c2[i] = input[i * 4 + 2];
+        c3[i] = input[i * 4 + 3];
+    }
+}
+
+static void InterleaveQuad(const int16_t* const* inputs, int16_t* output, size_t frames) {
+    const int16_t* c0 = inputs[0];
+    const int16_t* c1 = inputs[1];
+    const int16_t* c2 = inputs[2];
+    const int16_t* c3 = inputs[3];
+    size_t i = 0;
+    if (IsWordAligned(output) && IsWordAligned(c0) && IsWordAligned(c1) && IsWordAligned(c2) && IsWordAligned(c3)) {
+        auto out = (pcm_word_t*)__builtin_assume_aligned(output, 4);
+        for (; i + 2 <= frames; i += 2) {
+            uint32_t w0 = *(const pcm_word_t*)(c0 + i), w1 = *(const pcm_word_t*)(c1 + i);
+            uint32_t w2 = *(const pcm_word_t*)(c2 + i), w3 = *(const pcm_word_t*)(c3 + i);
+            out[0] = (w0 & 0xFFFF) | (w1 << 16);
+            out[1] = (w2 & 0xFFFF) | (w3 << 16);
+            out[2] = (w0 >> 16) | (w1 & 0xFFFF0000);
+            out[3] = (w2 >> 16) | (w3 & 0xFFFF0000);
+            out += 4;
+        }
+    }
+    for (; i < frames; i++) {
+        output[i * 4] = c0[i];
+        output[i * 4 + 1] = c1[i];
+        output[i * 4 + 2] = c2[i];
+        output[i * 4 + 3] = c3[i];
+    }
+}
+
+void DeinterleavePcm(const int16_t* input, int channels, int16_t* const* outputs, size_t frames) {
+    switch (channels) {
+        case 1:
+            memcpy(outputs[0], input, frames * sizeof(int16_t));
+            break;
+        case 2:
+            DeinterleaveStereo(input, outputs[0], outputs[1], frames);
+            break;
+        case 4:
+            DeinterleaveQuad(input, outputs, frames);
+            break;
+        default:
+            for (size_t i = 0; i < frames; i++) {
+                for (int c = 0; c < channels; c++) {
+                    outputs[c][i] = input[i * channels + c];
+                }
+            }
+            break;
+    }
+}
+
+void InterleavePcm(const int16_t* const* inputs, int channels, int16_t* output, size_t frames) {
+    switch (channels) {
+        case 1:
+            memcpy(output, inputs[0], frames * sizeof(int16_t));
+            break;
+        case 2:
+            InterleaveStereo(inputs[0], inputs[1], output, frames);
+            break;
+        case 4:
+            InterleaveQuad(inputs, output, frames);
+            break;
+        default:
+            for (size_t i = 0; i < frames; i++) {
+                for (int c = 0; c < channels; c++) {
+                    output[i * channels + c] = inputs[c][i];
+                }
+            }
+            break;
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef PCM_INTERLEAVE_H
+#define PCM_INTERLEAVE_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Split interleaved 16-bit PCM into one buffer per channel and back.
+// Mono is a copy, stereo and 4-channel layouts use unrolled 32-bit kernels
+// when every buffer is word aligned, anything else falls back to a plain loop.
+void DeinterleavePcm(const int16_t* input, int channels, int16_t* const* outputs, size_t frames);
+void InterleavePcm(const int16_t* const* inputs, int channels, int16_t* output, size_t frames);
+
+#endif // PCM_INTERLEAVE_H
@@ -0,0 +1,112 @@
+#include "pcm_ring.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#define TAG "PcmRing"
+
+PcmRing::PcmRing(size_t capacity, bool prefer_psram) : capacity_(capacity) {
+    if (prefer_psram) {
+        buffer_ = (int16_t*)heap_caps_malloc(capacity_ * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    }
+    if (buffer_ == nullptr) {
+        buffer_ = (int16_t*)heap_caps_malloc(capacity_ * sizeof(int16_t), MALLOC_CAP_8BIT);
+    }
+    if (buffer_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %zu samples", capacity_);
+        capacity_ = 0;
+    }
+}
+
+PcmRing::~PcmRing() {
+    if (buffer_ != nullptr) {
+        heap_caps_free(buffer_);
+    }
+}
+
+void PcmRing::Write(const int16_t* data, size_t samples) {
+    if (capacity_ == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint32_t generation = generation_;
+    while (samples > 0) {
+        cv_.wait(lock, [this, generation]() {
+            return size_ < capacity_ || generation_ != generation;
+        });
+        if (generation_ != generation) {
+            return;
+        }
+
+        size_t write_index = (read_index_ + size_) % capacity_;
+        size_t count = std::min(samples, capacity_ - size_);
+        count = std::min(count, capacity_ - write_index);
+        memcpy(buffer_ + write_index, data, count * sizeof(int16_t));
+        size_ += count;
+        data += count;
+        samples -= count;
+        cv_.notify_all();
+        if (data_callback_) {
+            data_callback_();
+        }
+    }
+}
+
+bool PcmRing::TryWrite(const int16_t* data, size_t samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity_ - size_ < samples) {
+        return false;
+    }
+    while (samples > 0) {
+        size_t write_index = (read_index_ + size_) % capacity_;
+        size_t count = std::min(samples, capacity_ - write_index);
+        memcpy(buffer_ + write_index, data, count * sizeof(int16_t));
+        size_ += count;
+        data += count;
+        samples -= count;
+    }
+    cv_.notify_all();
+    if (data_callback_) {
+        data_callback_();
+    }
+    return true;
+}
+
+size_t PcmRing::Read(int16_t* data, size_t max_samples, int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() { return size_ > 0; })) {
+        return 0;
+    }
+
+    size_t total = 0;
+    while (total < max_samples && size_ > 0) {
+        size_t count = std::min(max_samples - total, size_);
+        count = std::min(count, capacity_ - read_index_);
+        memcpy(data + total, buffer_ + read_index_, count * sizeof(int16_t));
+        read_index_ = (read_index_ + count) % capacity_;
+        size_ -= count;
+        total += count;
+    }
+    cv_.notify_all();
+    return total;
+}
+
+void PcmRing::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    read_index_ = 0;
+    size_ = 0;
+    generation_++;
+    cv_.notify_all();
+}
+
+void PcmRing::OnData(std::function<void()> callback) {
+    data_callback_ = callback;
+}
+
+size_t PcmRing::Size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
@@ -0,0 +1,48 @@
+#ifndef PCM_RING_H
+#define PCM_RING_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Bounded PCM sample FIFO between two audio tasks. On the output side the
+// decoder blocks in Write() while the ring is full, so its capacity is the
+// amount of audio decoded ahead of the speaker. Capture callbacks that must
+// not block use TryWrite() and drop the frame instead.
+class PcmRing {
+public:
+    PcmRing(size_t capacity, bool prefer_psram = false);
+    ~PcmRing();
+
+    PcmRing(const PcmRing&) = delete;
+    PcmRing& operator=(const PcmRing&) = delete;
+
+    // Blocks until all samples are queued, returns early if Clear() is called
+    void Write(const int16_t* data, size_t samples);
+    // Queues all samples or none, never blocks
+    bool TryWrite(const int16_t* data, size_t samples);
+    // Waits up to timeout_ms for data, returns the number of samples copied
+    size_t Read(int16_t* data, size_t max_samples, int timeout_ms);
+    void Clear();
+    // Called with the ring locked whenever samples are queued, so another
+    // consumer can wait on several rings at once. Set before the ring is used.
+    void OnData(std::function<void()> callback);
+
+    size_t Size() const;
+    inline bool Empty() const { return Size() == 0; }
+    inline size_t capacity() const { return capacity_; }
+
+private:
+    int16_t* buffer_ = nullptr;
+    size_t capacity_;
+    size_t read_index_ = 0;
+    size_t size_ = 0;
+    uint32_t generation_ = 0;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::function<void()> data_callback_;
+};
+
+#endif // PCM_RING_H
@@ -0,0 +1,16 @@
+#include "polyphase_resampler.h"
+
+#include <cmath>
+
+void DesignPolyphaseFilter(int up, int down, int taps, int16_t* coefficients) {
+    // Normalized to the upsampled rate, with ~10% of the band left for the transition
+    double cutoff = 0.5 / (up > down ? up : down) * 0.9;
+    double center = (taps - 1) / 2.0;
+    double scale = up * (1 << 14);
+    for (int i = 0; i < taps; i++) {
+        double t = i - center;
+        double sinc = t == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+        double window = 0.42 - 0.5 * cos(2 * M_PI * (i + 0.5) / taps) + 0.08 * cos(4 * M_PI * (i + 0.5) / taps);
+        coefficients[i] = (int16_t)lround(sinc * window * scale);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef POLYPHASE_RESAMPLER_H
+#define POLYPHASE_RESAMPLER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+// Streaming resampler for one fixed rational ratio
+class FixedRatioResampler {
+public:
+    virtual ~FixedRatioResampler() = default;
+    virtual void Process(const int16_t* input, size_t input_samples, int16_t* output) = 0;
+    virtual size_t GetOutputSamples(size_t input_samples) const = 0;
+    virtual void Reset() = 0;
+};
+
+// Fills `taps` Q14 coefficients of a Blackman-windowed sinc low-pass for
+// upsampling by `up`, cut off just below the lower of the two Nyquist rates.
+void DesignPolyphaseFilter(int up, int down, int taps, int16_t* coefficients);
+
+// Polyphase FIR resampler by Up/Down. The ratio and filter length are template
+// parameters so the inner loop has a constant trip count the compiler unrolls.
+// Coefficients are stored per phase and reversed, so each output is a single
+// forward dot product over contiguous input samples.
+template <int Up, int Down, int TapsPerPhase>
+class PolyphaseResampler : public FixedRatioResampler {
+public:
+    PolyphaseResampler() {
+        int16_t prototype[Up * TapsPerPhase];
+        DesignPolyphaseFilter(Up, Down, Up * TapsPerPhase, prototype);
+        for (int phase = 0; phase < Up; phase++) {
+            for (int k = 0; k < TapsPerPhase; k++) {
+                phases_[phase][TapsPerPhase - 1 - k] = prototype[phase + k * Up];
+            }
+        }
+        Reset();
+    }
+
+    void Reset() override {
+        history_.assign(TapsPerPhase - 1, 0);
+        position_ = 0;
+    }
+
+    size_t GetOutputSamples(size_t input_samples) const override {
+        int64_t end = (int64_t)input_samples * Up;
+        if (end <= position_) {
+            return 0;
+        }
+        return (end - position_ + Down - 1) / Down;
+    }
+
+    void Process(const int16_t* input, size_t input_samples, int16_t* output) override {
+        // Previous tail followed by the new input, capacity is kept between calls
+        history_.resize(TapsPerPhase - 1 + input_samples);
+        std::copy(input, input + input_samples, history_.begin() + TapsPerPhase - 1);
+        const int16_t* x = history_.data();
+
+        // position_ counts in 1/Up input samples from the first new sample
+        int64_t end = (int64_t)input_samples * Up;
+        int64_t position = position_;
+        for (; position < end; position += Down) {
+            size_t base = position / Up;
+            const int16_t* h = phases_[position % Up];
+            const int16_t* window = x + base;
+            int32_t sum = 1 << 13;
+            for (int k = 0; k < TapsPerPhase; k++) {
+                sum += (int32_t)window[k] * h[k];
+            }
+            sum >>= 14;
+            *output++ = sum > INT16_MAX ? INT16_MAX : (sum < INT16_MIN ? INT16_MIN : sum);
+        }
+        position_ = position - end;
+
+        std::copy(history_.end() - (TapsPerPhase - 1), history_.end(), history_.begin());
+        history_.resize(TapsPerPhase - 1);
+    }
+
+private:
+    int16_t phases_[Up][TapsPerPhase];
+    std::vector<int16_t> history_;
+    int64_t position_ = 0;
+};
+
+#endif // POLYPHASE_RESAMPLER_H
@@ -0,0 +1,61 @@
+#include "sound_cache.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+
+#define TAG "SoundCache"
+
+SoundCache::SoundCache(size_t budget_bytes) : budget_bytes_(budget_bytes) {
+}
+
+SoundCache::~SoundCache() {
+    for (auto& clip : clips_) {
+        heap_caps_free(clip.samples);
+    }
+}
+
+bool SoundCache::Find(const void* key, const int16_t*& samples, size_t& count) {
+    for (auto it = clips_.begin(); it != clips_.end(); ++it) {
+        if (it->key == key) {
+            clips_.splice(clips_.begin(), clips_, it);
+            samples = it->samples;
+            count = it->count;
+            return true;
+        }
+    }
+    return false;
+}
+
+int16_t* SoundCache::Allocate(size_t max_samples) {
+    // A single clip may take at most half of the budget, long prompts are decoded every time
+    if (max_samples * sizeof(int16_t) > budget_bytes_ / 2) {
+        return nullptr;
+    }
+    return (int16_t*)heap_caps_malloc(max_samples * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+}
+
+void SoundCache::Insert(const void* key, int16_t* samples, size_t count) {
+    if (count == 0) {
+        heap_caps_free(samples);
+        return;
+    }
+    // Give back the slack left by the size estimate
+    auto shrunk = (int16_t*)heap_caps_realloc(samples, count * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    if (shrunk != nullptr) {
+        samples = shrunk;
+    }
+    size_t bytes = count * sizeof(int16_t);
+    while (!clips_.empty() && used_bytes_ + bytes > budget_bytes_) {
+        auto& oldest = clips_.back();
+        used_bytes_ -= oldest.count * sizeof(int16_t);
+        heap_caps_free(oldest.samples);
+        clips_.pop_back();
+    }
+    clips_.push_front({key, samples, count});
+    used_bytes_ += bytes;
+    ESP_LOGI(TAG, "Cached %zu samples, %zu / %zu bytes in use", count, used_bytes_, budget_bytes_);
+}
+
+void SoundCache::Free(int16_t* samples) {
+    heap_caps_free(samples);
+}
@@ -0,0 +1,40 @@
+#ifndef SOUND_CACHE_H
+#define SOUND_CACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+
+// Decoded PCM of embedded sound assets, keyed by the asset address.
+// Clips live in PSRAM and the least recently played ones are evicted once
+// the byte budget is exceeded. Without PSRAM nothing is cached.
+// Not thread safe, owned by the sound task.
+class SoundCache {
+public:
+    explicit SoundCache(size_t budget_bytes);
+    ~SoundCache();
+
+    SoundCache(const SoundCache&) = delete;
+    SoundCache& operator=(const SoundCache&) = delete;
+
+    // The pointer stays valid until the next Insert()
+    bool Find(const void* key, const int16_t*& samples, size_t& count);
+    // Room for a clip of up to max_samples, nullptr if the clip should not be cached
+    int16_t* Allocate(size_t max_samples);
+    // Takes ownership of a buffer from Allocate() that holds count samples
+    void Insert(const void* key, int16_t* samples, size_t count);
+    void Free(int16_t* samples);
+
+private:
+    struct Clip {
+        const void* key;
+        int16_t* samples;
+        size_t count;
+    };
+    size_t budget_bytes_;
+    size_t used_bytes_ = 0;
+    // Most recently played first
+    std::list<Clip> clips_;
+};
+
+#endif // SOUND_CACHE_H
@@ -0,0 +1,88 @@
+#include "vad_gate.h"
+
+#include <algorithm>
+#include <cstring>
+
+VadGate::VadGate(int sample_rate, int hangover_ms, int preroll_ms)
+    : sample_rate_(sample_rate),
+      hangover_samples_((size_t)sample_rate * hangover_ms / 1000),
+      preroll_((size_t)sample_rate * preroll_ms / 1000) {
+    Reset();
+}
+
+void VadGate::SetSpeaking(bool speaking) {
+    speaking_ = speaking;
+}
+
+void VadGate::Reset() {
+    speaking_ = false;
+    open_ = true;
+    hangover_left_ = hangover_samples_;
+    preroll_start_ = 0;
+    preroll_size_ = 0;
+    dropped_samples_ = 0;
+}
+
+size_t VadGate::Process(const int16_t* data, size_t samples, const std::function<void(const int16_t* data, size_t samples)>& emit) {
+    if (speaking_) {
+        hangover_left_ = hangover_samples_;
+    }
+
+    if (open_) {
+        if (!speaking_) {
+            if (hangover_left_ == 0) {
+                open_ = false;
+                HoldBack(data, samples);
+                return 0;
+            }
+            hangover_left_ -= std::min(hangover_left_, samples);
+        }
+        emit(data, samples);
+        return 0;
+    }
+
+    if (!speaking_) {
+        HoldBack(data, samples);
+        return 0;
+    }
+
+    // Speech onset: the pre-roll window goes out first, in capture order
+    size_t gap = dropped_samples_;
+    size_t first = std::min(preroll_size_, preroll_.size() - preroll_start_);
+    if (first > 0) {
+        emit(preroll_.data() + preroll_start_, first);
+    }
+    if (preroll_size_ > first) {
+        emit(preroll_.data(), preroll_size_ - first);
+    }
+    emit(data, samples);
+
+    open_ = true;
+    preroll_start_ = 0;
+    preroll_size_ = 0;
+    dropped_samples_ = 0;
+    return gap;
+}
+
+void VadGate::HoldBack(const int16_t* data, size_t samples) {
+    const size_t capacity = preroll_.size();
+    if (samples >= capacity) {
+        dropped_samples_ += preroll_size_ + samples - capacity;
+        memcpy(preroll_.data(), data + samples - capacity, capacity * sizeof(int16_t));
+        preroll_start_ = 0;
+        preroll_size_ = capacity;
+        return;
+    }
+
+    // Make room by dropping the oldest samples, then append
+    size_t overflow = preroll_size_ + samples > capacity ? preroll_size_ + samples - capacity : 0;
+    preroll_start_ = (preroll_start_ + overflow) % capacity;
+    preroll_size_ -= overflow;
+    dropped_samples_ += overflow;
+
+    size_t write_index = (preroll_start_ + preroll_size_) % capacity;
+    size_t count = std::min(samples, capacity - write_index);
+    memcpy(preroll_.data() + write_index, data, count * sizeof(int16_t));
+    memcpy(preroll_.data(), data + count, (samples - count) * sizeof(int16_t));
+    preroll_size_ += samples;
+}
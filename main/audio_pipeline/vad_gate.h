@@ -0,0 +1,45 @@
+#ifndef VAD_GATE_H
+#define VAD_GATE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+
+// Discontinuous transmission for the uplink. While the VAD reports speech and
+// for a hangover after it, frames pass through. After that they are held in
+// a pre-roll window, so the audio leading into the next speech onset is sent
+// together with it and the first syllable is not clipped. Everything older
+// than the window is dropped and reported as a gap when the gate reopens.
+// Not thread safe, fed from the capture task together with the VAD events.
+class VadGate {
+public:
+    VadGate(int sample_rate, int hangover_ms, int preroll_ms);
+
+    void SetSpeaking(bool speaking);
+    // Passes whatever should be encoded to emit, oldest samples first. Returns
+    // the number of samples dropped right before the emitted audio, non-zero
+    // only on the call that reopens the gate.
+    size_t Process(const int16_t* data, size_t samples, const std::function<void(const int16_t* data, size_t samples)>& emit);
+    // Opens the gate with a fresh hangover, e.g. when a listening session starts
+    void Reset();
+
+    inline bool open() const { return open_; }
+    inline int sample_rate() const { return sample_rate_; }
+
+private:
+    int sample_rate_;
+    size_t hangover_samples_;
+    std::vector<int16_t> preroll_;
+    size_t preroll_start_ = 0;
+    size_t preroll_size_ = 0;
+
+    bool speaking_ = false;
+    bool open_ = true;
+    size_t hangover_left_ = 0;
+    size_t dropped_samples_ = 0;
+
+    void HoldBack(const int16_t* data, size_t samples);
+};
+
+#endif // VAD_GATE_H
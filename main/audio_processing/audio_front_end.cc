@@ -0,0 +1,233 @@
+#include "audio_front_end.h"
+
+#include <esp_log.h>
+#include <model_path.h>
+#include <cstring>
+#include <sstream>
+
+#define WAKE_WORD_ENABLED 0x01
+#define VOICE_COMMUNICATION_ENABLED 0x02
+#define FRONT_END_RUNNING (WAKE_WORD_ENABLED | VOICE_COMMUNICATION_ENABLED)
+
+static const char* TAG = "AudioFrontEnd";
+
+AudioFrontEnd::AudioFrontEnd() {
+    event_group_ = xEventGroupCreate();
+}
+
+AudioFrontEnd::~AudioFrontEnd() {
+    if (afe_data_ != nullptr) {
+        afe_iface_->destroy(afe_data_);
+    }
+    vEventGroupDelete(event_group_);
+}
+
+void AudioFrontEnd::Initialize(AudioCodec* codec, bool wake_word, bool voice_communication, bool realtime_chat) {
+    codec_ = codec;
+    realtime_chat_ = realtime_chat;
+    int ref_num = codec_->input_reference() ? 1 : 0;
+
+    srmodel_list_t *models = esp_srmodel_init("model");
+    char* wakenet_model = nullptr;
+    for (int i = 0; wake_word && i < models->num; i++) {
+        ESP_LOGI(TAG, "Model %d: %s", i, models->model_name[i]);
+        if (strstr(models->model_name[i], ESP_WN_PREFIX) != NULL) {
+            wakenet_model = models->model_name[i];
+            auto words = esp_srmodel_get_wake_words(models, wakenet_model);
+            // split by ";" to get all wake words
+            std::stringstream ss(words);
+            std::string word;
+            while (std::getline(ss, word, ';')) {
+                wake_words_.push_back(word);
+            }
+        }
+    }
+
+    std::string input_format;
+    for (int i = 0; i < codec_->input_channels() - ref_num; i++) {
+        input_format.push_back('M');
+    }
+    for (int i = 0; i < ref_num; i++) {
+        input_format.push_back('R');
+    }
+
+    // The pipeline type, and with it the AEC mode below, is fixed when the AFE is created.
+    // WakeNet only runs in the SR type, so with a wake word model voice communication runs
+    // on it too. Its AEC, NS, VAD and AGC are still set up and switched exactly as the VC
+    // pipeline had them, which leaves the type's internal tuning as the only difference.
+    afe_type_t type = wakenet_model != nullptr ? AFE_TYPE_SR : AFE_TYPE_VC;
+    afe_config_t* afe_config = afe_config_init(input_format.c_str(), models, type, AFE_MODE_HIGH_PERF);
+    afe_config->wakenet_init = wakenet_model != nullptr;
+    // AEC as the separate pipelines had it: WakeNet always cancels the speaker, voice
+    // communication only in realtime chat. Realtime barge-in needs the VoIP mode while the
+    // answer plays, so WakeNet runs on that mode too when both are configured. It listens
+    // while the device is idle, when the speaker only plays the odd notification sound.
+    aec_available_ = codec_->input_reference() && (wakenet_model != nullptr || realtime_chat);
+    afe_config->aec_init = aec_available_;
+    afe_config->aec_mode = realtime_chat ? AEC_MODE_VOIP_HIGH_PERF : AEC_MODE_SR_HIGH_PERF;
+    afe_config->ns_init = voice_communication;
+    if (voice_communication) {
+        afe_config->ns_model_name = esp_srmodel_filter(models, ESP_NSNET_PREFIX, NULL);
+        afe_config->afe_ns_mode = AFE_NS_MODE_NET;
+    }
+    // Realtime chat streams continuously and relies on the server VAD
+    afe_config->vad_init = voice_communication && !realtime_chat;
+    afe_config->vad_mode = VAD_MODE_0;
+    afe_config->vad_min_noise_ms = 100;
+    afe_config->afe_perferred_core = 1;
+    afe_config->afe_perferred_priority = 1;
+    // The wake word pipeline kept the SR default, the VC pipeline had AGC off
+    agc_available_ = wakenet_model != nullptr && afe_config->agc_init;
+    afe_config->agc_init = agc_available_;
+    afe_config->memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
+
+    afe_iface_ = esp_afe_handle_from_config(afe_config);
+    afe_data_ = afe_iface_->create_from_config(afe_config);
+    afe_config_free(afe_config);
+
+    // Features start switched off, the owners enable them with the device state
+    if (wakenet_model != nullptr) {
+        afe_iface_->disable_wakenet(afe_data_);
+    }
+    if (voice_communication) {
+        afe_iface_->disable_ns(afe_data_);
+    }
+    aec_enabled_ = aec_available_;
+    agc_enabled_ = agc_available_;
+    UpdateStages();
+
+    xTaskCreate([](void* arg) {
+        auto this_ = (AudioFrontEnd*)arg;
+        this_->AudioFrontEndTask();
+        vTaskDelete(NULL);
+    }, "audio_front_end", 4096 * 2, this, 3, NULL);
+}
+
+size_t AudioFrontEnd::GetFeedSize() {
+    if (afe_data_ == nullptr) {
+        return 0;
+    }
+    return afe_iface_->get_feed_chunksize(afe_data_) * codec_->input_channels();
+}
+
+void AudioFrontEnd::Feed(const std::vector<int16_t>& data) {
+    if (afe_data_ == nullptr) {
+        return;
+    }
+    afe_iface_->feed(afe_data_, data.data());
+}
+
+bool AudioFrontEnd::IsRunning() {
+    return xEventGroupGetBits(event_group_) & FRONT_END_RUNNING;
+}
+
+void AudioFrontEnd::EnableWakeWord(bool enable) {
+    if (afe_data_ == nullptr || enable == IsWakeWordEnabled()) {
+        return;
+    }
+    if (enable) {
+        afe_iface_->enable_wakenet(afe_data_);
+    } else {
+        afe_iface_->disable_wakenet(afe_data_);
+    }
+    SetFeature(WAKE_WORD_ENABLED, enable);
+    UpdateStages();
+}
+
+void AudioFrontEnd::EnableVoiceCommunication(bool enable) {
+    if (afe_data_ == nullptr || enable == IsVoiceCommunicationEnabled()) {
+        return;
+    }
+    if (enable) {
+        afe_iface_->enable_ns(afe_data_);
+        if (!realtime_chat_) {
+            afe_iface_->reset_vad(afe_data_);
+        }
+    } else {
+        afe_iface_->disable_ns(afe_data_);
+    }
+    SetFeature(VOICE_COMMUNICATION_ENABLED, enable);
+    UpdateStages();
+}
+
+// Switches the stages the two pipelines configured differently before they were merged.
+// Outside realtime chat voice communication ran without AEC, so AEC is only on while
+// WakeNet listens. AGC only ran on the wake word path, so it is off while voice
+// communication is enabled, also while both features overlap during a hand-over.
+void AudioFrontEnd::UpdateStages() {
+    bool aec = aec_available_ && (realtime_chat_ || IsWakeWordEnabled());
+    if (aec != aec_enabled_) {
+        if (aec) {
+            afe_iface_->enable_aec(afe_data_);
+        } else {
+            afe_iface_->disable_aec(afe_data_);
+        }
+        aec_enabled_ = aec;
+    }
+
+    bool agc = agc_available_ && !IsVoiceCommunicationEnabled();
+    if (agc != agc_enabled_) {
+        if (agc) {
+            afe_iface_->enable_agc(afe_data_);
+        } else {
+            afe_iface_->disable_agc(afe_data_);
+        }
+        agc_enabled_ = agc;
+    }
+}
+
+bool AudioFrontEnd::IsWakeWordEnabled() {
+    return xEventGroupGetBits(event_group_) & WAKE_WORD_ENABLED;
+}
+
+bool AudioFrontEnd::IsVoiceCommunicationEnabled() {
+    return xEventGroupGetBits(event_group_) & VOICE_COMMUNICATION_ENABLED;
+}
+
+// Stale audio is only dropped when the last feature goes away. Handing over
+// from one feature to the other keeps the pipeline and its buffers running.
+void AudioFrontEnd::SetFeature(EventBits_t bit, bool enable) {
+    if (enable) {
+        xEventGroupSetBits(event_group_, bit);
+        return;
+    }
+    xEventGroupClearBits(event_group_, bit);
+    if ((xEventGroupGetBits(event_group_) & FRONT_END_RUNNING) == 0) {
+        afe_iface_->reset_buffer(afe_data_);
+    }
+}
+
+void AudioFrontEnd::OnWakeWordFrame(std::function<void(afe_fetch_result_t* result)> callback) {
+    wake_word_callback_ = callback;
+}
+
+void AudioFrontEnd::OnVoiceFrame(std::function<void(afe_fetch_result_t* result)> callback) {
+    voice_callback_ = callback;
+}
+
+void AudioFrontEnd::AudioFrontEndTask() {
+    auto fetch_size = afe_iface_->get_fetch_chunksize(afe_data_);
+    auto feed_size = afe_iface_->get_feed_chunksize(afe_data_);
+    ESP_LOGI(TAG, "Audio front end task started, feed size: %d fetch size: %d",
+        feed_size, fetch_size);
+
+    while (true) {
+        xEventGroupWaitBits(event_group_, FRONT_END_RUNNING, pdFALSE, pdFALSE, portMAX_DELAY);
+
+        auto res = afe_iface_->fetch_with_delay(afe_data_, portMAX_DELAY);
+        if (res == nullptr || res->ret_value == ESP_FAIL) {
+            if (res != nullptr) {
+                ESP_LOGI(TAG, "Error code: %d", res->ret_value);
+            }
+            continue;
+        }
+
+        EventBits_t bits = xEventGroupGetBits(event_group_);
+        if ((bits & VOICE_COMMUNICATION_ENABLED) && voice_callback_) {
+            voice_callback_(res);
+        }
+        if ((bits & WAKE_WORD_ENABLED) && wake_word_callback_) {
+            wake_word_callback_(res);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef AUDIO_FRONT_END_H
+#define AUDIO_FRONT_END_H
+
+#include <esp_afe_sr_models.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "audio_codec.h"
+
+// The single AFE pipeline of the device. Wake word detection and voice
+// communication are features switched on the running pipeline instead of
+// two AFE instances, so the models are loaded once, one task fetches, and
+// nothing is lost when the device hands the microphone from one to the other.
+// Frame callbacks run on the front end task.
+class AudioFrontEnd {
+public:
+    AudioFrontEnd();
+    ~AudioFrontEnd();
+
+    void Initialize(AudioCodec* codec, bool wake_word, bool voice_communication, bool realtime_chat);
+    void Feed(const std::vector<int16_t>& data);
+    size_t GetFeedSize();
+    // True while any feature is enabled and the pipeline wants audio
+    bool IsRunning();
+
+    void EnableWakeWord(bool enable);
+    void EnableVoiceCommunication(bool enable);
+    bool IsWakeWordEnabled();
+    bool IsVoiceCommunicationEnabled();
+
+    void OnWakeWordFrame(std::function<void(afe_fetch_result_t* result)> callback);
+    void OnVoiceFrame(std::function<void(afe_fetch_result_t* result)> callback);
+
+    inline const std::vector<std::string>& wake_words() const { return wake_words_; }
+
+private:
+    EventGroupHandle_t event_group_ = nullptr;
+    esp_afe_sr_iface_t* afe_iface_ = nullptr;
+    esp_afe_sr_data_t* afe_data_ = nullptr;
+    AudioCodec* codec_ = nullptr;
+    bool realtime_chat_ = false;
+    bool aec_available_ = false;
+    bool aec_enabled_ = false;
+    bool agc_available_ = false;
+    bool agc_enabled_ = false;
+    std::vector<std::string> wake_words_;
+    std::function<void(afe_fetch_result_t* result)> wake_word_callback_;
+    std::function<void(afe_fetch_result_t* result)> voice_callback_;
+
+    void SetFeature(EventBits_t bit, bool enable);
+    void UpdateStages();
+    void AudioFrontEndTask();
+};
+
+#endif // AUDIO_FRONT_END_H
@@ -1,41 +1,36 @@
 #ifndef AUDIO_PROCESSOR_H
 #define AUDIO_PROCESSOR_H
 
-#include <esp_afe_sr_models.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
-#include <freertos/event_groups.h>
-
 #include <string>
 #include <vector>
 #include <functional>
 
-#include "audio_codec.h"
+#include "audio_front_end.h"
 
 class AudioProcessor {
 public:
     AudioProcessor();
     ~AudioProcessor();
 
-    void Initialize(AudioCodec* codec, bool realtime_chat);
-    void Feed(const std::vector<int16_t>& data);
+    // Runs on the shared front end, which must be initialized with voice communication
+    void Initialize(AudioFrontEnd* front_end);
     void Start();
     void Stop();
     bool IsRunning();
-    void OnOutput(std::function<void(std::vector<int16_t>&& data)> callback);
+    // The samples point into the AFE result and are only valid during the call
+    void OnOutput(std::function<void(const int16_t* data, size_t samples)> callback);
     void OnVadStateChange(std::function<void(bool speaking)> callback);
-    size_t GetFeedSize();
 
 private:
-    EventGroupHandle_t event_group_ = nullptr;
-    esp_afe_sr_iface_t* afe_iface_ = nullptr;
-    esp_afe_sr_data_t* afe_data_ = nullptr;
-    std::function<void(std::vector<int16_t>&& data)> output_callback_;
+    AudioFrontEnd* front_end_ = nullptr;
+    std::function<void(const int16_t* data, size_t samples)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
-    AudioCodec* codec_ = nullptr;
     bool is_speaking_ = false;
+    // Debug check that the output path stays allocation free
+    uint32_t frame_count_ = 0;
+    size_t allocated_blocks_ = 0;
 
-    void AudioProcessorTask();
+    void OnFrame(afe_fetch_result_t* res);
 };
 
 #endif
@@ -2,186 +2,154 @@
 #include "application.h"
 
 #include <esp_log.h>
-#include <model_path.h>
 #include <arpa/inet.h>
-#include <sstream>
-
-#define DETECTION_RUNNING_EVENT 1
 
 static const char* TAG = "WakeWordDetect";
 
-WakeWordDetect::WakeWordDetect()
-    : afe_data_(nullptr),
-      wake_word_pcm_(),
-      wake_word_opus_() {
-
-    event_group_ = xEventGroupCreate();
+WakeWordDetect::WakeWordDetect() {
 }
 
 WakeWordDetect::~WakeWordDetect() {
-    if (afe_data_ != nullptr) {
-        afe_iface_->destroy(afe_data_);
-    }
-
     if (wake_word_encode_task_stack_ != nullptr) {
         heap_caps_free(wake_word_encode_task_stack_);
     }
-
-    vEventGroupDelete(event_group_);
 }
 
-void WakeWordDetect::Initialize(AudioCodec* codec) {
-    codec_ = codec;
-    int ref_num = codec_->input_reference() ? 1 : 0;
-
-    srmodel_list_t *models = esp_srmodel_init("model");
-    for (int i = 0; i < models->num; i++) {
-        ESP_LOGI(TAG, "Model %d: %s", i, models->model_name[i]);
-        if (strstr(models->model_name[i], ESP_WN_PREFIX) != NULL) {
-            wakenet_model_ = models->model_name[i];
-            auto words = esp_srmodel_get_wake_words(models, wakenet_model_);
-            // split by ";" to get all wake words
-            std::stringstream ss(words);
-            std::string word;
-            while (std::getline(ss, word, ';')) {
-                wake_words_.push_back(word);
-            }
-        }
-    }
+void WakeWordDetect::Initialize(AudioFrontEnd* front_end) {
+    front_end_ = front_end;
+    front_end_->OnWakeWordFrame([this](afe_fetch_result_t* res) {
+        OnFrame(res);
+    });
 
-    std::string input_format;
-    for (int i = 0; i < codec_->input_channels() - ref_num; i++) {
-        input_format.push_back('M');
-    }
-    for (int i = 0; i < ref_num; i++) {
-        input_format.push_back('R');
-    }
-    afe_config_t* afe_config = afe_config_init(input_format.c_str(), models, AFE_TYPE_SR, AFE_MODE_HIGH_PERF);
-    afe_config->aec_init = codec_->input_reference();
-    afe_config->aec_mode = AEC_MODE_SR_HIGH_PERF;
-    afe_config->afe_perferred_core = 1;
-    afe_config->afe_perferred_priority = 1;
-    afe_config->memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
-    
-    afe_iface_ = esp_afe_handle_from_config(afe_config);
-    afe_data_ = afe_iface_->create_from_config(afe_config);
-
-    xTaskCreate([](void* arg) {
+    wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(4096 * 8, MALLOC_CAP_SPIRAM);
+    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
         auto this_ = (WakeWordDetect*)arg;
-        this_->AudioDetectionTask();
+        this_->PreRollEncodeTask();
         vTaskDelete(NULL);
-    }, "audio_detection", 4096, this, 3, nullptr);
+    }, "encode_detect_packets", 4096 * 8, this, 2, wake_word_encode_task_stack_, &wake_word_encode_task_buffer_);
 }
 
 void WakeWordDetect::OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback) {
     wake_word_detected_callback_ = callback;
 }
 
+void WakeWordDetect::OnSpeechStart(std::function<void()> callback) {
+    speech_start_callback_ = callback;
+}
+
 void WakeWordDetect::StartDetection() {
-    xEventGroupSetBits(event_group_, DETECTION_RUNNING_EVENT);
+    {
+        std::lock_guard<std::mutex> lock(wake_word_mutex_);
+        wake_word_opus_.Clear();
+        wake_word_complete_ = false;
+    }
+    wake_word_pcm_.Clear();
+    wake_word_flush_time_ = 0;
+    wake_word_restart_ = true;
+    front_end_->EnableWakeWord(true);
 }
 
 void WakeWordDetect::StopDetection() {
-    xEventGroupClearBits(event_group_, DETECTION_RUNNING_EVENT);
-    if (afe_data_ != nullptr) {
-        afe_iface_->reset_buffer(afe_data_);
-    }
+    front_end_->EnableWakeWord(false);
 }
 
 bool WakeWordDetect::IsDetectionRunning() {
-    return xEventGroupGetBits(event_group_) & DETECTION_RUNNING_EVENT;
+    return front_end_->IsWakeWordEnabled();
 }
 
-void WakeWordDetect::Feed(const std::vector<int16_t>& data) {
-    if (afe_data_ == nullptr) {
-        return;
+// Called on the front end task for every frame while detection runs
+void WakeWordDetect::OnFrame(afe_fetch_result_t* res) {
+    // Store the wake word data for voice recognition, like who is speaking
+    StoreWakeWordData(res->data, res->data_size / sizeof(int16_t));
+
+    if (res->vad_state == VAD_SPEECH && !is_speaking_) {
+        is_speaking_ = true;
+        if (speech_start_callback_) {
+            speech_start_callback_();
+        }
+    } else if (res->vad_state == VAD_SILENCE) {
+        is_speaking_ = false;
+    }
+
+    if (res->wakeup_state == WAKENET_DETECTED) {
+        StopDetection();
+        last_detected_wake_word_ = front_end_->wake_words()[res->wake_word_index - 1];
+
+        if (wake_word_detected_callback_) {
+            wake_word_detected_callback_(last_detected_wake_word_);
+        }
     }
-    afe_iface_->feed(afe_data_, data.data());
 }
 
-size_t WakeWordDetect::GetFeedSize() {
-    if (afe_data_ == nullptr) {
-        return 0;
+void WakeWordDetect::StoreWakeWordData(const int16_t* data, size_t samples) {
+    // The encoder keeps up at complexity 0, if it ever falls behind the chunk is lost
+    if (!wake_word_pcm_.TryWrite(data, samples)) {
+        ESP_LOGW(TAG, "Pre-roll encoder is behind, dropped %zu samples", samples);
     }
-    return afe_iface_->get_feed_chunksize(afe_data_) * codec_->input_channels();
 }
 
-void WakeWordDetect::AudioDetectionTask() {
-    auto fetch_size = afe_iface_->get_fetch_chunksize(afe_data_);
-    auto feed_size = afe_iface_->get_feed_chunksize(afe_data_);
-    ESP_LOGI(TAG, "Audio detection task started, feed size: %d fetch size: %d",
-        feed_size, fetch_size);
+// Keeps the Opus pre-roll up to date while detection runs, so after a detection only
+// the audio captured since the last full frame is left to encode
+void WakeWordDetect::PreRollEncodeTask() {
+    std::unique_ptr<OpusEncoderWrapper> encoder;
+    std::vector<int16_t> pcm;
 
     while (true) {
-        xEventGroupWaitBits(event_group_, DETECTION_RUNNING_EVENT, pdFALSE, pdTRUE, portMAX_DELAY);
-
-        auto res = afe_iface_->fetch_with_delay(afe_data_, portMAX_DELAY);
-        if (res == nullptr || res->ret_value == ESP_FAIL) {
-            continue;;
+        int frame_duration = wake_word_frame_duration_;
+        if (wake_word_restart_.exchange(false) || !encoder || encoder->duration_ms() != frame_duration) {
+            if (!encoder || encoder->duration_ms() != frame_duration) {
+                encoder = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration);
+                encoder->SetComplexity(0); // 0 is the fastest
+            } else {
+                encoder->ResetState();
+            }
         }
 
-        // Store the wake word data for voice recognition, like who is speaking
-        StoreWakeWordData((uint16_t*)res->data, res->data_size / sizeof(uint16_t));
-
-        if (res->wakeup_state == WAKENET_DETECTED) {
-            StopDetection();
-            last_detected_wake_word_ = wake_words_[res->wake_word_index - 1];
-
-            if (wake_word_detected_callback_) {
-                wake_word_detected_callback_(last_detected_wake_word_);
+        int64_t flush_time = wake_word_flush_time_;
+        bool flush = flush_time != 0;
+        pcm.resize(16000 * frame_duration / 1000);
+        size_t samples = wake_word_pcm_.Read(pcm.data(), pcm.size(), flush ? 0 : 100);
+        if (samples == 0) {
+            if (flush) {
+                std::lock_guard<std::mutex> lock(wake_word_mutex_);
+                if (!wake_word_complete_) {
+                    wake_word_complete_ = true;
+                    wake_word_cv_.notify_all();
+                    ESP_LOGI(TAG, "Wake word pre-roll of %zu packets complete %lld ms after the request",
+                        wake_word_opus_.Size(), (esp_timer_get_time() - flush_time) / 1000);
+                }
+                // Back to blocking reads until the next detection, unless a new flush came in meanwhile
+                wake_word_flush_time_.compare_exchange_strong(flush_time, 0);
             }
+            continue;
         }
+
+        pcm.resize(samples);
+        encoder->Encode(std::move(pcm), [this, frame_duration](std::vector<uint8_t>&& opus) {
+            std::lock_guard<std::mutex> lock(wake_word_mutex_);
+            while (wake_word_opus_.Size() >= (size_t)(WAKE_WORD_PREROLL_MS / frame_duration)) {
+                wake_word_opus_.Pop(wake_word_dropped_);
+            }
+            if (!wake_word_opus_.Push(opus.data(), opus.size())) {
+                ESP_LOGW(TAG, "Pre-roll ring rejected a %zu byte packet", opus.size());
+            }
+            wake_word_cv_.notify_all();
+        });
     }
 }
 
-void WakeWordDetect::StoreWakeWordData(uint16_t* data, size_t samples) {
-    // store audio data to wake_word_pcm_
-    wake_word_pcm_.emplace_back(std::vector<int16_t>(data, data + samples));
-    // keep about 2 seconds of data, detect duration is 32ms (sample_rate == 16000, chunksize == 512)
-    while (wake_word_pcm_.size() > 2000 / 32) {
-        wake_word_pcm_.pop_front();
-    }
+void WakeWordDetect::SetFrameDuration(int frame_duration_ms) {
+    wake_word_frame_duration_ = frame_duration_ms;
 }
 
 void WakeWordDetect::EncodeWakeWordData() {
-    wake_word_opus_.clear();
-    if (wake_word_encode_task_stack_ == nullptr) {
-        wake_word_encode_task_stack_ = (StackType_t*)heap_caps_malloc(4096 * 8, MALLOC_CAP_SPIRAM);
-    }
-    wake_word_encode_task_ = xTaskCreateStatic([](void* arg) {
-        auto this_ = (WakeWordDetect*)arg;
-        {
-            auto start_time = esp_timer_get_time();
-            auto encoder = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-            encoder->SetComplexity(0); // 0 is the fastest
-
-            for (auto& pcm: this_->wake_word_pcm_) {
-                encoder->Encode(std::move(pcm), [this_](std::vector<uint8_t>&& opus) {
-                    std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-                    this_->wake_word_opus_.emplace_back(std::move(opus));
-                    this_->wake_word_cv_.notify_all();
-                });
-            }
-            this_->wake_word_pcm_.clear();
-
-            auto end_time = esp_timer_get_time();
-            ESP_LOGI(TAG, "Encode wake word opus %zu packets in %lld ms",
-                this_->wake_word_opus_.size(), (end_time - start_time) / 1000);
-
-            std::lock_guard<std::mutex> lock(this_->wake_word_mutex_);
-            this_->wake_word_opus_.push_back(std::vector<uint8_t>());
-            this_->wake_word_cv_.notify_all();
-        }
-        vTaskDelete(NULL);
-    }, "encode_detect_packets", 4096 * 8, this, 2, wake_word_encode_task_stack_, &wake_word_encode_task_buffer_);
+    wake_word_flush_time_ = esp_timer_get_time();
 }
 
 bool WakeWordDetect::GetWakeWordOpus(std::vector<uint8_t>& opus) {
     std::unique_lock<std::mutex> lock(wake_word_mutex_);
     wake_word_cv_.wait(lock, [this]() {
-        return !wake_word_opus_.empty();
+        return !wake_word_opus_.Empty() || wake_word_complete_;
     });
-    opus.swap(wake_word_opus_.front());
-    wake_word_opus_.pop_front();
-    return !opus.empty();
+    return wake_word_opus_.Pop(opus);
 }
@@ -8,51 +8,71 @@
 #include <esp_afe_sr_models.h>
 #include <esp_nsn_models.h>
 
-#include <list>
 #include <string>
 #include <vector>
 #include <functional>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 
-#include "audio_codec.h"
+#include "audio_front_end.h"
+#include "pcm_ring.h"
+#include "audio_packet_ring.h"
+
+// Audio kept from before the detection, sent to the server for speaker recognition
+#define WAKE_WORD_PREROLL_MS 2000
+// Enough for the pre-roll at the shortest frame duration, plus the slot of the
+// packet pushed after trimming, so the ring never fills up
+#define WAKE_WORD_PREROLL_PACKETS (WAKE_WORD_PREROLL_MS / 20 + 1)
 
 class WakeWordDetect {
 public:
     WakeWordDetect();
     ~WakeWordDetect();
 
-    void Initialize(AudioCodec* codec);
-    void Feed(const std::vector<int16_t>& data);
+    // Runs on the shared front end, which must be initialized with wake word support
+    void Initialize(AudioFrontEnd* front_end);
     void OnWakeWordDetected(std::function<void(const std::string& wake_word)> callback);
+    // Speech onset while detection runs, only reported when the front end runs VAD
+    void OnSpeechStart(std::function<void()> callback);
     void StartDetection();
     void StopDetection();
     bool IsDetectionRunning();
-    size_t GetFeedSize();
+    // Frame duration of the pre-roll packets, applies from the next StartDetection()
+    void SetFrameDuration(int frame_duration_ms);
+    // Finishes the pre-roll after a detection, only the last partial frame is left to encode
     void EncodeWakeWordData();
+    // Oldest pre-roll packet first, false once the pre-roll is exhausted
     bool GetWakeWordOpus(std::vector<uint8_t>& opus);
     const std::string& GetLastDetectedWakeWord() const { return last_detected_wake_word_; }
 
 private:
-    esp_afe_sr_iface_t* afe_iface_ = nullptr;
-    esp_afe_sr_data_t* afe_data_ = nullptr;
-    char* wakenet_model_ = NULL;
-    std::vector<std::string> wake_words_;
-    EventGroupHandle_t event_group_;
+    AudioFrontEnd* front_end_ = nullptr;
     std::function<void(const std::string& wake_word)> wake_word_detected_callback_;
-    AudioCodec* codec_ = nullptr;
     std::string last_detected_wake_word_;
+    std::function<void()> speech_start_callback_;
+    bool is_speaking_ = false;
 
     TaskHandle_t wake_word_encode_task_ = nullptr;
     StaticTask_t wake_word_encode_task_buffer_;
     StackType_t* wake_word_encode_task_stack_ = nullptr;
-    std::list<std::vector<int16_t>> wake_word_pcm_;
-    std::list<std::vector<uint8_t>> wake_word_opus_;
+    std::atomic<int> wake_word_frame_duration_{60};
+    // Detection audio waiting for the pre-roll encoder, which runs alongside detection
+    // at complexity 0 so the packets are ready by the time the audio channel opens
+    PcmRing wake_word_pcm_{16000 * 500 / 1000, true};
+    // The last WAKE_WORD_PREROLL_MS of encoded audio, guarded by wake_word_mutex_
+    AudioPacketRing wake_word_opus_{WAKE_WORD_PREROLL_PACKETS, 512};
+    std::vector<uint8_t> wake_word_dropped_;
     std::mutex wake_word_mutex_;
     std::condition_variable wake_word_cv_;
+    bool wake_word_complete_ = false;
+    // When EncodeWakeWordData() was called, 0 while detection runs and once the pre-roll is complete
+    std::atomic<int64_t> wake_word_flush_time_{0};
+    std::atomic<bool> wake_word_restart_{false};
 
-    void StoreWakeWordData(uint16_t* data, size_t size);
-    void AudioDetectionTask();
+    void StoreWakeWordData(const int16_t* data, size_t samples);
+    void OnFrame(afe_fetch_result_t* res);
+    void PreRollEncodeTask();
 };
 
 #endif
@@ -155,6 +155,9 @@ private:
             gpio_set_level(BUILTIN_LED_GPIO, 1);
             app.ToggleChatState();
         });
+        boot_button_.OnPressDown([this]() {
+            Application::GetInstance().PrewarmAudioChannel();
+        });
 
         asr_button_.OnClick([this]() {
             std::string wake_word="你好小智";
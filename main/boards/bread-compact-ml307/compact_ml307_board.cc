@@ -98,6 +98,9 @@ private:
         boot_button_.OnClick([this]() {
             Application::GetInstance().ToggleChatState();
         });
+        boot_button_.OnPressDown([this]() {
+            Application::GetInstance().PrewarmAudioChannel();
+        });
         touch_button_.OnPressDown([this]() {
             Application::GetInstance().StartListening();
         });
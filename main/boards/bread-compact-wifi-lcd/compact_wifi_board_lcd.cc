@@ -145,6 +145,9 @@ private:
             }
             app.ToggleChatState();
         });
+        boot_button_.OnPressDown([this]() {
+            Application::GetInstance().PrewarmAudioChannel();
+        });
     }
 
     // 物联网初始化，添加对 AI 可见设备
@@ -111,6 +111,9 @@ private:
             }
             app.ToggleChatState();
         });
+        boot_button_.OnPressDown([this]() {
+            Application::GetInstance().PrewarmAudioChannel();
+        });
         touch_button_.OnPressDown([this]() {
             Application::GetInstance().StartListening();
         });
@@ -0,0 +1,59 @@
+#include "audio_cipher.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cstring>
+
+AudioCipher::AudioCipher() {
+    mbedtls_aes_init(&ctx_);
+}
+
+AudioCipher::~AudioCipher() {
+    mbedtls_aes_free(&ctx_);
+}
+
+bool AudioCipher::SetKey(const std::string& key) {
+    // Start from a clean context, the previous session may have left a key
+    mbedtls_aes_free(&ctx_);
+    mbedtls_aes_init(&ctx_);
+    ready_ = key.size() == 16 &&
+        mbedtls_aes_setkey_enc(&ctx_, (const unsigned char*)key.data(), 128) == 0;
+    return ready_;
+}
+
+bool AudioCipher::Crypt(const uint8_t* header, const uint8_t* input, uint8_t* output, size_t size) {
+    if (!ready_) {
+        return false;
+    }
+    int64_t start_time = esp_timer_get_time();
+
+    // mbedtls advances the counter block in place, the header must stay intact
+    uint8_t counter[AUDIO_CIPHER_HEADER_SIZE];
+    memcpy(counter, header, sizeof(counter));
+    uint8_t stream_block[16];
+    size_t nc_off = 0;
+    if (mbedtls_aes_crypt_ctr(&ctx_, size, &nc_off, counter, stream_block, input, output) != 0) {
+        return false;
+    }
+
+    packets_++;
+    bytes_ += size;
+    busy_us_ += esp_timer_get_time() - start_time;
+    return true;
+}
+
+void AudioCipher::ResetStats() {
+    packets_ = 0;
+    bytes_ = 0;
+    busy_us_ = 0;
+}
+
+void AudioCipher::LogStats(const char* tag) const {
+    uint32_t packets = packets_;
+    if (packets == 0) {
+        return;
+    }
+    int64_t busy_us = busy_us_;
+    ESP_LOGI(tag, "Audio cipher: %lu packets, %lu bytes, %lld us total, %lld us per packet",
+        packets, (uint32_t)bytes_, busy_us, busy_us / packets);
+}
@@ -0,0 +1,44 @@
+#ifndef AUDIO_CIPHER_H
+#define AUDIO_CIPHER_H
+
+#include <mbedtls/aes.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <string>
+
+#define AUDIO_CIPHER_HEADER_SIZE 16
+
+// AES-128-CTR for the UDP audio channel, shared by both directions.
+// Each packet starts with a 16-byte header (the session nonce with the
+// payload size and sequence filled in) that is also its initial counter
+// block, so a packet's keystream is only known once its size is. The whole
+// payload is handed to mbedtls in one call, which runs on the AES
+// peripheral when hardware AES is enabled.
+// Crypt may run on several tasks at once, SetKey must not overlap it.
+class AudioCipher {
+public:
+    AudioCipher();
+    ~AudioCipher();
+
+    AudioCipher(const AudioCipher&) = delete;
+    AudioCipher& operator=(const AudioCipher&) = delete;
+
+    bool SetKey(const std::string& key);
+    // CTR is symmetric, so this both encrypts and decrypts.
+    // input and output may point to the same buffer.
+    bool Crypt(const uint8_t* header, const uint8_t* input, uint8_t* output, size_t size);
+    void ResetStats();
+    // Packets processed and CPU time spent on them since the last ResetStats()
+    void LogStats(const char* tag) const;
+
+private:
+    mbedtls_aes_context ctx_;
+    bool ready_ = false;
+    std::atomic<uint32_t> packets_{0};
+    std::atomic<uint32_t> bytes_{0};
+    std::atomic<int64_t> busy_us_{0};
+};
+
+#endif // AUDIO_CIPHER_H
@@ -0,0 +1,169 @@
+#include "jitter_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+#define MIN_GAP_WAIT_US 10000
+// Longer gaps are pauses in the stream rather than jitter
+#define MAX_INTERARRIVAL_US 1000000
+
+JitterBuffer::JitterBuffer(size_t capacity, size_t max_packet_size)
+    : capacity_(capacity), max_packet_size_(max_packet_size),
+      storage_(capacity * max_packet_size), sizes_(capacity), occupied_(capacity) {
+    Reset(60);
+}
+
+void JitterBuffer::OnOutput(std::function<void(const uint8_t* data, size_t size)> callback) {
+    output_callback_ = callback;
+}
+
+void JitterBuffer::Reset(int frame_duration_ms) {
+    std::fill(occupied_.begin(), occupied_.end(), false);
+    started_ = false;
+    buffered_ = 0;
+    gap_start_us_ = -1;
+
+    frame_duration_us_ = frame_duration_ms * 1000;
+    last_arrival_us_ = -1;
+    interarrival_us_ = frame_duration_us_;
+    jitter_us_ = 0;
+    gap_wait_us_ = frame_duration_us_;
+
+    lost_packets_ = 0;
+    late_packets_ = 0;
+    reordered_packets_ = 0;
+    high_water_ = 0;
+    exhausted_ = 0;
+}
+
+void JitterBuffer::UpdateJitter(int64_t now_us) {
+    if (last_arrival_us_ >= 0) {
+        int64_t delta = std::min<int64_t>(now_us - last_arrival_us_, MAX_INTERARRIVAL_US);
+        // Smoothed inter-arrival time (gain 1/8) and its mean deviation (RFC 3550 style, gain 1/16)
+        interarrival_us_ += (delta - interarrival_us_) / 8;
+        jitter_us_ += (std::llabs(delta - interarrival_us_) - jitter_us_) / 16;
+        gap_wait_us_ = std::clamp(interarrival_us_ + 4 * jitter_us_, MIN_GAP_WAIT_US, 3 * frame_duration_us_);
+    }
+    last_arrival_us_ = now_us;
+}
+
+void JitterBuffer::Push(uint32_t sequence, const uint8_t* data, size_t size, int64_t now_us) {
+    uint8_t* slot = Reserve(sequence, size, now_us);
+    if (slot != nullptr) {
+        memcpy(slot, data, size);
+        Commit(sequence, size, now_us);
+    }
+}
+
+uint8_t* JitterBuffer::Reserve(uint32_t sequence, size_t size, int64_t now_us) {
+    if (size > max_packet_size_) {
+        return nullptr;
+    }
+    UpdateJitter(now_us);
+
+    if (!started_) {
+        started_ = true;
+        next_sequence_ = sequence;
+    }
+
+    int32_t offset = (int32_t)(sequence - next_sequence_);
+    if (offset < 0) {
+        // Already played or concealed
+        late_packets_++;
+        return nullptr;
+    }
+    if (offset >= (int32_t)capacity_) {
+        exhausted_++;
+        Resync(sequence);
+    }
+
+    size_t index = sequence % capacity_;
+    if (occupied_[index]) {
+        // Duplicate
+        return nullptr;
+    }
+    return &storage_[index * max_packet_size_];
+}
+
+void JitterBuffer::Commit(uint32_t sequence, size_t size, int64_t now_us) {
+    size_t index = sequence % capacity_;
+    if (sequence == next_sequence_ && buffered_ > 0) {
+        reordered_packets_++;
+    }
+    sizes_[index] = size;
+    occupied_[index] = true;
+    buffered_++;
+    high_water_ = std::max(high_water_, buffered_);
+
+    Release(now_us);
+}
+
+void JitterBuffer::Poll(int64_t now_us) {
+    Release(now_us);
+}
+
+int64_t JitterBuffer::NextDeadline() const {
+    if (buffered_ == 0 || gap_start_us_ < 0) {
+        return -1;
+    }
+    return gap_start_us_ + gap_wait_us_;
+}
+
+void JitterBuffer::Release(int64_t now_us) {
+    while (true) {
+        size_t index = next_sequence_ % capacity_;
+        if (occupied_[index]) {
+            Emit(index);
+            next_sequence_++;
+            gap_start_us_ = -1;
+            continue;
+        }
+        if (buffered_ == 0) {
+            gap_start_us_ = -1;
+            break;
+        }
+
+        // There is a gap in front of the buffered packets
+        if (gap_start_us_ < 0) {
+            gap_start_us_ = now_us;
+        }
+        // Give up on the missing packet when its wait expires or the window is full
+        if (buffered_ < capacity_ - 1 && now_us - gap_start_us_ < gap_wait_us_) {
+            break;
+        }
+        if (buffered_ >= capacity_ - 1) {
+            exhausted_++;
+        }
+        lost_packets_++;
+        next_sequence_++;
+        if (output_callback_) {
+            output_callback_(nullptr, 0);
+        }
+    }
+}
+
+void JitterBuffer::Emit(size_t index) {
+    occupied_[index] = false;
+    buffered_--;
+    if (output_callback_) {
+        output_callback_(&storage_[index * max_packet_size_], sizes_[index]);
+    }
+}
+
+void JitterBuffer::Resync(uint32_t sequence) {
+    // The stream jumped further than we can buffer, flush what we have
+    // in order without concealment and restart at the new sequence
+    while (buffered_ > 0) {
+        size_t index = next_sequence_ % capacity_;
+        if (occupied_[index]) {
+            Emit(index);
+        } else {
+            lost_packets_++;
+        }
+        next_sequence_++;
+    }
+    lost_packets_ += sequence - next_sequence_;
+    next_sequence_ = sequence;
+    gap_start_us_ = -1;
+}
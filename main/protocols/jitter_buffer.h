@@ -0,0 +1,74 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+
+// Reorders downlink audio packets by sequence number.
+// In-order packets are released immediately. When a sequence gap appears the
+// buffer holds later packets until either the missing one arrives or the gap
+// wait expires, then reports the missing frame as lost (an empty packet) so
+// the decoder can conceal it. The gap wait follows the measured inter-arrival
+// jitter. Time is passed in by the caller so the class runs on a host too.
+// Not thread safe, the owner serializes Push/Poll/Reset.
+class JitterBuffer {
+public:
+    JitterBuffer(size_t capacity, size_t max_packet_size);
+
+    void Reset(int frame_duration_ms);
+    void Push(uint32_t sequence, const uint8_t* data, size_t size, int64_t now_us);
+    // Zero-copy Push: returns the slot for the packet so the caller can fill
+    // it in place (e.g. decrypt into it), or nullptr if the packet is late, a
+    // duplicate or too large. The packet only enters the buffer on Commit().
+    uint8_t* Reserve(uint32_t sequence, size_t size, int64_t now_us);
+    void Commit(uint32_t sequence, size_t size, int64_t now_us);
+    // Release packets whose gap wait has expired
+    void Poll(int64_t now_us);
+    // Absolute time at which Poll() should run next, or -1 if nothing is pending
+    int64_t NextDeadline() const;
+    // size == 0 marks a lost frame
+    void OnOutput(std::function<void(const uint8_t* data, size_t size)> callback);
+
+    inline uint32_t lost_packets() const { return lost_packets_; }
+    inline uint32_t late_packets() const { return late_packets_; }
+    inline uint32_t reordered_packets() const { return reordered_packets_; }
+    inline int jitter_us() const { return jitter_us_; }
+    inline int gap_wait_us() const { return gap_wait_us_; }
+    // Most slots ever in use, and how often a full buffer forced packets out early
+    inline size_t high_water() const { return high_water_; }
+    inline uint32_t exhausted() const { return exhausted_; }
+
+private:
+    size_t capacity_;
+    size_t max_packet_size_;
+    std::vector<uint8_t> storage_;
+    std::vector<uint16_t> sizes_;
+    std::vector<bool> occupied_;
+    std::function<void(const uint8_t* data, size_t size)> output_callback_;
+
+    bool started_ = false;
+    uint32_t next_sequence_ = 0;
+    size_t buffered_ = 0;
+    int64_t gap_start_us_ = -1;
+
+    int frame_duration_us_ = 60000;
+    int64_t last_arrival_us_ = -1;
+    int interarrival_us_ = 0;
+    int jitter_us_ = 0;
+    int gap_wait_us_ = 0;
+
+    uint32_t lost_packets_ = 0;
+    uint32_t late_packets_ = 0;
+    uint32_t reordered_packets_ = 0;
+    size_t high_water_ = 0;
+    uint32_t exhausted_ = 0;
+
+    void UpdateJitter(int64_t now_us);
+    void Release(int64_t now_us);
+    void Emit(size_t index);
+    void Resync(uint32_t sequence);
+};
+
+#endif // JITTER_BUFFER_H
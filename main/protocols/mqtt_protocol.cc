@@ -14,10 +14,65 @@
 
 MqttProtocol::MqttProtocol() {
     event_group_handle_ = xEventGroupCreate();
+
+    esp_timer_create_args_t jitter_timer_args = {
+        .callback = [](void* arg) {
+            MqttProtocol* protocol = (MqttProtocol*)arg;
+            protocol->OnJitterTimer();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "jitter_timer",
+        .skip_unhandled_events = true
+    };
+    esp_timer_create(&jitter_timer_args, &jitter_timer_);
+
+    esp_timer_create_args_t session_timer_args = {
+        .callback = [](void* arg) {
+            MqttProtocol* protocol = (MqttProtocol*)arg;
+            Application::GetInstance().Schedule([protocol]() {
+                if (protocol->session_parked_) {
+                    ESP_LOGI(TAG, "Parked audio session expired");
+                    protocol->EndSession(true);
+                }
+            });
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "session_timer",
+        .skip_unhandled_events = true
+    };
+    esp_timer_create(&session_timer_args, &session_timer_);
+
+    esp_timer_create_args_t prewarm_timer_args = {
+        .callback = [](void* arg) {
+            MqttProtocol* protocol = (MqttProtocol*)arg;
+            Application::GetInstance().Schedule([protocol]() {
+                protocol->OnPrewarmTimeout();
+            });
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "prewarm_timer",
+        .skip_unhandled_events = true
+    };
+    esp_timer_create(&prewarm_timer_args, &prewarm_timer_);
 }
 
 MqttProtocol::~MqttProtocol() {
     ESP_LOGI(TAG, "MqttProtocol deinit");
+    if (jitter_timer_ != nullptr) {
+        esp_timer_stop(jitter_timer_);
+        esp_timer_delete(jitter_timer_);
+    }
+    if (session_timer_ != nullptr) {
+        esp_timer_stop(session_timer_);
+        esp_timer_delete(session_timer_);
+    }
+    if (prewarm_timer_ != nullptr) {
+        esp_timer_stop(prewarm_timer_);
+        esp_timer_delete(prewarm_timer_);
+    }
     if (udp_ != nullptr) {
         delete udp_;
     }
@@ -73,13 +128,33 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
         }
 
         if (strcmp(type->valuestring, "hello") == 0) {
-            ParseServerHello(root);
+            // Hellos are answered in order, so the first one after SendHello() is taken. Whichever
+            // answer is left over, from a pre-warm or handshake that was given up, is released.
+            std::lock_guard<std::mutex> lock(hello_mutex_);
+            if (hello_pending_) {
+                hello_pending_ = false;
+                ParseServerHello(root);
+            } else {
+                auto session_id = cJSON_GetObjectItem(root, "session_id");
+                if (session_id != nullptr && session_id_ != session_id->valuestring) {
+                    ESP_LOGI(TAG, "Releasing unused session %s", session_id->valuestring);
+                    Application::GetInstance().Schedule([this, session_id = std::string(session_id->valuestring)]() {
+                        SendGoodbye(session_id);
+                    });
+                }
+            }
         } else if (strcmp(type->valuestring, "goodbye") == 0) {
             auto session_id = cJSON_GetObjectItem(root, "session_id");
             ESP_LOGI(TAG, "Received goodbye message, session_id: %s", session_id ? session_id->valuestring : "null");
             if (session_id == nullptr || session_id_ == session_id->valuestring) {
                 Application::GetInstance().Schedule([this]() {
-                    CloseAudioChannel();
+                    // The server ended the session, it cannot be resumed
+                    session_resumable_ = false;
+                    if (session_parked_) {
+                        EndSession(false);
+                    } else {
+                        CloseAudioChannel();
+                    }
                 });
             }
         } else if (on_incoming_json_ != nullptr) {
@@ -121,28 +196,93 @@ void MqttProtocol::SendAudio(const std::vector<uint8_t>& data) {
         return;
     }
 
-    std::string nonce(aes_nonce_);
-    *(uint16_t*)&nonce[2] = htons(data.size());
-    *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
-
-    std::string encrypted;
-    encrypted.resize(aes_nonce_.size() + data.size());
-    memcpy(encrypted.data(), nonce.data(), nonce.size());
+    // The header is written in place and the payload encrypted straight behind it
+    send_buffer_.resize(MQTT_UDP_HEADER_SIZE + data.size());
+    uint8_t* packet = (uint8_t*)send_buffer_.data();
+    memcpy(packet, aes_nonce_.data(), MQTT_UDP_HEADER_SIZE);
+    *(uint16_t*)&packet[2] = htons(data.size());
+    *(uint32_t*)&packet[12] = htonl(++local_sequence_);
 
-    size_t nc_off = 0;
-    uint8_t stream_block[16] = {0};
-    if (mbedtls_aes_crypt_ctr(&aes_ctx_, data.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
-        (uint8_t*)data.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
+    if (!cipher_.Crypt(packet, data.data(), packet + MQTT_UDP_HEADER_SIZE, data.size())) {
         ESP_LOGE(TAG, "Failed to encrypt audio data");
         return;
     }
 
     busy_sending_audio_ = true;
-    udp_->Send(encrypted);
+    udp_->Send(send_buffer_);
     busy_sending_audio_ = false;
 }
 
 void MqttProtocol::CloseAudioChannel() {
+    {
+        std::lock_guard<std::mutex> lock(jitter_mutex_);
+        if (jitter_buffer_ != nullptr) {
+            esp_timer_stop(jitter_timer_);
+            ESP_LOGI(TAG, "Jitter buffer: lost %lu, late %lu, reordered %lu, jitter %d us",
+                jitter_buffer_->lost_packets(), jitter_buffer_->late_packets(),
+                jitter_buffer_->reordered_packets(), jitter_buffer_->jitter_us());
+            ESP_LOGI(TAG, "Receive pool: high water %zu/%d, exhausted %lu",
+                jitter_buffer_->high_water(), MQTT_JITTER_BUFFER_PACKETS, jitter_buffer_->exhausted());
+            jitter_buffer_.reset();
+        }
+    }
+    cipher_.LogStats(TAG);
+
+    if (!ParkSession()) {
+        EndSession(true);
+    }
+
+    if (on_audio_channel_closed_ != nullptr) {
+        on_audio_channel_closed_();
+    }
+}
+
+bool MqttProtocol::ParkSession() {
+#if CONFIG_MQTT_SESSION_KEEP_ALIVE_SECONDS > 0
+    if (!session_resumable_ || session_parked_ || error_occurred_ || udp_ == nullptr) {
+        return false;
+    }
+    std::string message = "{";
+    message += "\"session_id\":\"" + session_id_ + "\",";
+    message += "\"type\":\"suspend\"";
+    message += "}";
+    if (!SendText(message)) {
+        return false;
+    }
+    session_parked_ = true;
+    esp_timer_stop(session_timer_);
+    esp_timer_start_once(session_timer_, CONFIG_MQTT_SESSION_KEEP_ALIVE_SECONDS * 1000000LL);
+    ESP_LOGI(TAG, "Audio session parked for %d seconds", CONFIG_MQTT_SESSION_KEEP_ALIVE_SECONDS);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool MqttProtocol::ResumeSession() {
+    esp_timer_stop(session_timer_);
+    session_parked_ = false;
+    busy_sending_audio_ = false;
+    error_occurred_ = false;
+
+    // Same key and socket, and the uplink sequence carries on so no counter block is reused
+    std::string message = "{";
+    message += "\"session_id\":\"" + session_id_ + "\",";
+    message += "\"type\":\"resume\"";
+    message += "}";
+    if (!SendText(message)) {
+        EndSession(false);
+        return false;
+    }
+    CreateJitterBuffer();
+    last_incoming_time_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+void MqttProtocol::EndSession(bool send_goodbye) {
+    esp_timer_stop(session_timer_);
+    session_parked_ = false;
+    session_resumable_ = false;
     {
         std::lock_guard<std::mutex> lock(channel_mutex_);
         if (udp_ != nullptr) {
@@ -151,57 +291,156 @@ void MqttProtocol::CloseAudioChannel() {
         }
     }
 
+    if (send_goodbye) {
+        SendGoodbye(session_id_);
+    }
+}
+
+void MqttProtocol::SendGoodbye(const std::string& session_id) {
     std::string message = "{";
-    message += "\"session_id\":\"" + session_id_ + "\",";
+    message += "\"session_id\":\"" + session_id + "\",";
     message += "\"type\":\"goodbye\"";
     message += "}";
     SendText(message);
+}
 
-    if (on_audio_channel_closed_ != nullptr) {
-        on_audio_channel_closed_();
+bool MqttProtocol::SendHello() {
+    busy_sending_audio_ = false;
+    error_occurred_ = false;
+    {
+        std::lock_guard<std::mutex> lock(hello_mutex_);
+        session_id_ = "";
+        hello_pending_ = true;
+        xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
+    }
+
+    // 发送 hello 消息申请 UDP 通道
+    std::string message = "{";
+    message += "\"type\":\"hello\",";
+    message += "\"version\": 3,";
+    message += "\"transport\":\"udp\",";
+    message += GetHelloAudioParams();
+    message += "}";
+    if (!SendText(message)) {
+        AbandonHello();
+        return false;
+    }
+    return true;
+}
+
+// Stops waiting for the answer to the last hello and returns true if it already arrived
+bool MqttProtocol::AbandonHello() {
+    std::lock_guard<std::mutex> lock(hello_mutex_);
+    bool pending = hello_pending_;
+    hello_pending_ = false;
+    EventBits_t bits = xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
+    return !pending && (bits & MQTT_PROTOCOL_SERVER_HELLO_EVENT);
+}
+
+void MqttProtocol::PrewarmAudioChannel(int timeout_ms) {
+    // Nothing to gain with a channel that is open, parked or already warming up,
+    // and reconnecting MQTT would block, so that is left to OpenAudioChannel()
+    if (prewarm_pending_ || session_parked_ || udp_ != nullptr) {
+        return;
+    }
+    if (mqtt_ == nullptr || !mqtt_->IsConnected()) {
+        return;
+    }
+    if (!SendHello()) {
+        return;
+    }
+    prewarm_pending_ = true;
+    prewarm_time_ = esp_timer_get_time();
+    esp_timer_start_once(prewarm_timer_, timeout_ms * 1000LL);
+    ESP_LOGI(TAG, "Audio session pre-warm started");
+}
+
+// Runs on the main task, prewarm_timer_ schedules it
+void MqttProtocol::OnPrewarmTimeout() {
+    if (!prewarm_pending_) {
+        return;
+    }
+    prewarm_pending_ = false;
+    ESP_LOGI(TAG, "Pre-warmed audio session not used, releasing it");
+
+    // A hello still on its way is released by the message handler when it arrives
+    if (AbandonHello()) {
+        SendGoodbye(session_id_);
     }
 }
 
+void MqttProtocol::CreateJitterBuffer() {
+    // Packets leave the jitter buffer in sequence order, lost ones as empty packets
+    std::lock_guard<std::mutex> lock(jitter_mutex_);
+    jitter_buffer_ = std::make_unique<JitterBuffer>(MQTT_JITTER_BUFFER_PACKETS, AUDIO_DECODE_MAX_PACKET_SIZE);
+    jitter_buffer_->Reset(server_frame_duration_);
+    jitter_buffer_->OnOutput([this](const uint8_t* data, size_t size) {
+        if (on_incoming_audio_ != nullptr) {
+            on_incoming_audio_(data, size);
+        }
+    });
+}
+
 bool MqttProtocol::OpenAudioChannel() {
+    int64_t start_time = esp_timer_get_time();
     if (mqtt_ == nullptr || !mqtt_->IsConnected()) {
         ESP_LOGI(TAG, "MQTT is not connected, try to connect now");
+        // The server drops the session together with the MQTT connection
+        if (session_parked_) {
+            EndSession(false);
+        }
+        if (prewarm_pending_) {
+            esp_timer_stop(prewarm_timer_);
+            prewarm_pending_ = false;
+        }
         if (!StartMqttClient(true)) {
             return false;
         }
     }
 
-    busy_sending_audio_ = false;
-    error_occurred_ = false;
-    session_id_ = "";
-    xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
+    if (session_parked_) {
+        if (!ResumeSession()) {
+            return false;
+        }
+        resume_stats_.Add(esp_timer_get_time() - start_time);
+        resume_stats_.Log(TAG, "Audio session resume");
+        if (on_audio_channel_opened_ != nullptr) {
+            on_audio_channel_opened_();
+        }
+        return true;
+    }
 
-    // 发送 hello 消息申请 UDP 通道
-    std::string message = "{";
-    message += "\"type\":\"hello\",";
-    message += "\"version\": 3,";
-    message += "\"transport\":\"udp\",";
-    message += "\"audio_params\":{";
-    message += "\"format\":\"opus\", \"sample_rate\":16000, \"channels\":1, \"frame_duration\":" + std::to_string(OPUS_FRAME_DURATION_MS);
-    message += "}}";
-    if (!SendText(message)) {
+    if (prewarm_pending_) {
+        // The hello went out on the trigger, its answer may already be here
+        esp_timer_stop(prewarm_timer_);
+        prewarm_pending_ = false;
+        ESP_LOGI(TAG, "Using pre-warmed audio session, hello sent %lld ms ago", (start_time - prewarm_time_) / 1000);
+    } else if (!SendHello()) {
         return false;
     }
 
     // 等待服务器响应
-    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
+    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(MQTT_HELLO_TIMEOUT_MS));
     if (!(bits & MQTT_PROTOCOL_SERVER_HELLO_EVENT)) {
+        // Should the answer still turn up, its session is released
+        if (AbandonHello()) {
+            SendGoodbye(session_id_);
+        }
         ESP_LOGE(TAG, "Failed to receive server hello");
         SetError(Lang::Strings::SERVER_TIMEOUT);
         return false;
     }
 
-    std::lock_guard<std::mutex> lock(channel_mutex_);
+    CreateJitterBuffer();
+
+    std::unique_lock<std::mutex> lock(channel_mutex_);
     if (udp_ != nullptr) {
         delete udp_;
     }
     udp_ = Board::GetInstance().CreateUdp();
+    send_buffer_.reserve(MQTT_UDP_HEADER_SIZE + AUDIO_UPLINK_MAX_PACKET_SIZE);
     udp_->OnMessage([this](const std::string& data) {
-        if (data.size() < sizeof(aes_nonce_)) {
+        if (data.size() < MQTT_UDP_HEADER_SIZE) {
             ESP_LOGE(TAG, "Invalid audio packet size: %zu", data.size());
             return;
         }
@@ -210,35 +449,33 @@ bool MqttProtocol::OpenAudioChannel() {
             return;
         }
         uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
-            return;
-        }
-        if (sequence != remote_sequence_ + 1) {
-            ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
-        }
-
-        std::vector<uint8_t> decrypted;
-        size_t decrypted_size = data.size() - aes_nonce_.size();
-        size_t nc_off = 0;
-        uint8_t stream_block[16] = {0};
-        decrypted.resize(decrypted_size);
-        auto nonce = (uint8_t*)data.data();
-        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
-        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)decrypted.data());
-        if (ret != 0) {
-            ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
-            return;
-        }
-        if (on_incoming_audio_ != nullptr) {
-            on_incoming_audio_(std::move(decrypted));
+        auto header = (const uint8_t*)data.data();
+        size_t size = data.size() - MQTT_UDP_HEADER_SIZE;
+        {
+            // Decrypt straight into the jitter buffer slot, which is handed on to the decode ring
+            std::lock_guard<std::mutex> lock(jitter_mutex_);
+            if (jitter_buffer_ != nullptr) {
+                int64_t now = esp_timer_get_time();
+                uint8_t* slot = jitter_buffer_->Reserve(sequence, size, now);
+                if (slot != nullptr) {
+                    if (cipher_.Crypt(header, header + MQTT_UDP_HEADER_SIZE, slot, size)) {
+                        jitter_buffer_->Commit(sequence, size, now);
+                    } else {
+                        ESP_LOGE(TAG, "Failed to decrypt audio data");
+                    }
+                }
+                ArmJitterTimer();
+            }
         }
-        remote_sequence_ = sequence;
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
     udp_->Connect(udp_server_, udp_port_);
+    lock.unlock();
+    session_resumable_ = true;
 
+    handshake_stats_.Add(esp_timer_get_time() - start_time);
+    handshake_stats_.Log(TAG, "Audio session handshake");
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
     }
@@ -284,13 +521,37 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
     // auto encryption = cJSON_GetObjectItem(udp, "encryption")->valuestring;
     // ESP_LOGI(TAG, "UDP server: %s, port: %d, encryption: %s", udp_server_.c_str(), udp_port_, encryption);
     aes_nonce_ = DecodeHexString(nonce);
-    mbedtls_aes_init(&aes_ctx_);
-    mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
+    if (aes_nonce_.size() != MQTT_UDP_HEADER_SIZE) {
+        ESP_LOGE(TAG, "Invalid nonce size: %zu", aes_nonce_.size());
+        return;
+    }
+    if (!cipher_.SetKey(DecodeHexString(key))) {
+        ESP_LOGE(TAG, "Invalid audio key");
+        return;
+    }
+    cipher_.ResetStats();
     local_sequence_ = 0;
-    remote_sequence_ = 0;
     xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 }
 
+// Called with jitter_mutex_ held
+void MqttProtocol::ArmJitterTimer() {
+    esp_timer_stop(jitter_timer_);
+    int64_t deadline = jitter_buffer_->NextDeadline();
+    if (deadline >= 0) {
+        int64_t timeout = deadline - esp_timer_get_time();
+        esp_timer_start_once(jitter_timer_, timeout > 1000 ? timeout : 1000);
+    }
+}
+
+void MqttProtocol::OnJitterTimer() {
+    std::lock_guard<std::mutex> lock(jitter_mutex_);
+    if (jitter_buffer_ != nullptr) {
+        jitter_buffer_->Poll(esp_timer_get_time());
+        ArmJitterTimer();
+    }
+}
+
 static const char hex_chars[] = "0123456789ABCDEF";
 // 辅助函数，将单个十六进制字符转换为对应的数值
 static inline uint8_t CharToHex(char c) {
@@ -311,5 +572,5 @@ std::string MqttProtocol::DecodeHexString(const std::string& hex_string) {
 }
 
 bool MqttProtocol::IsAudioChannelOpened() const {
-    return udp_ != nullptr && !error_occurred_ && !IsTimeout();
+    return udp_ != nullptr && !session_parked_ && !error_occurred_ && !IsTimeout();
 }
@@ -3,20 +3,30 @@
 
 
 #include "protocol.h"
+#include "jitter_buffer.h"
+#include "audio_cipher.h"
+#include "latency_stats.h"
 #include <mqtt.h>
 #include <udp.h>
 #include <cJSON.h>
-#include <mbedtls/aes.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <esp_timer.h>
 
 #include <functional>
 #include <string>
 #include <map>
 #include <mutex>
+#include <memory>
+#include <atomic>
 
 #define MQTT_PING_INTERVAL_SECONDS 90
 #define MQTT_RECONNECT_INTERVAL_MS 10000
+#define MQTT_JITTER_BUFFER_PACKETS 8
+// UDP audio header, which doubles as the AES-CTR counter block of the packet
+#define MQTT_UDP_HEADER_SIZE AUDIO_CIPHER_HEADER_SIZE
+
+#define MQTT_HELLO_TIMEOUT_MS 10000
 
 #define MQTT_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
 
@@ -28,6 +38,7 @@ public:
     void Start() override;
     void SendAudio(const std::vector<uint8_t>& data) override;
     bool OpenAudioChannel() override;
+    void PrewarmAudioChannel(int timeout_ms) override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
 
@@ -43,16 +54,50 @@ private:
     std::mutex channel_mutex_;
     Mqtt* mqtt_ = nullptr;
     Udp* udp_ = nullptr;
-    mbedtls_aes_context aes_ctx_;
+    AudioCipher cipher_;
     std::string aes_nonce_;
     std::string udp_server_;
     int udp_port_;
     uint32_t local_sequence_;
-    uint32_t remote_sequence_;
+    // Outgoing datagram, reused so that sending does not allocate once it has
+    // grown to the largest packet. Guarded by channel_mutex_.
+    std::string send_buffer_;
+
+    // With CONFIG_MQTT_SESSION_KEEP_ALIVE_SECONDS, CloseAudioChannel() parks the
+    // session: the UDP socket, key and sequence stay alive and the next
+    // OpenAudioChannel() resumes it without waiting for a server hello.
+    bool session_resumable_ = false;
+    bool session_parked_ = false;
+    esp_timer_handle_t session_timer_ = nullptr;
+    LatencyStats handshake_stats_;
+    LatencyStats resume_stats_;
+
+    // Hello sent by PrewarmAudioChannel() that no OpenAudioChannel() has claimed yet
+    bool prewarm_pending_ = false;
+    int64_t prewarm_time_ = 0;
+    esp_timer_handle_t prewarm_timer_ = nullptr;
+    // A hello was sent and its answer is still wanted. Server hellos that arrive
+    // while this is false answer an abandoned hello and are released right away.
+    std::mutex hello_mutex_;
+    bool hello_pending_ = false;
+
+    std::mutex jitter_mutex_;
+    std::unique_ptr<JitterBuffer> jitter_buffer_;
+    esp_timer_handle_t jitter_timer_ = nullptr;
 
     bool StartMqttClient(bool report_error=false);
     void ParseServerHello(const cJSON* root);
     std::string DecodeHexString(const std::string& hex_string);
+    void OnJitterTimer();
+    void ArmJitterTimer();
+    void CreateJitterBuffer();
+    bool ParkSession();
+    bool ResumeSession();
+    void EndSession(bool send_goodbye);
+    bool SendHello();
+    void SendGoodbye(const std::string& session_id);
+    bool AbandonHello();
+    void OnPrewarmTimeout();
 
     bool SendText(const std::string& text) override;
 };
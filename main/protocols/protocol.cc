@@ -8,7 +8,7 @@ void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
-void Protocol::OnIncomingAudio(std::function<void(std::vector<uint8_t>&& data)> callback) {
+void Protocol::OnIncomingAudio(std::function<void(const uint8_t* data, size_t size)> callback) {
     on_incoming_audio_ = callback;
 }
 
@@ -24,6 +24,40 @@ void Protocol::OnNetworkError(std::function<void(const std::string& message)> ca
     on_network_error_ = callback;
 }
 
+void Protocol::SetPreferredDownlink(const std::vector<int>& sample_rates, const std::vector<int>& frame_durations) {
+    preferred_sample_rates_ = sample_rates;
+    preferred_frame_durations_ = frame_durations;
+}
+
+void Protocol::SetUplinkFrameDuration(int frame_duration) {
+    uplink_frame_duration_ = frame_duration;
+}
+
+static std::string JoinNumbers(const std::vector<int>& values) {
+    std::string result = "[";
+    for (size_t i = 0; i < values.size(); i++) {
+        if (i > 0) {
+            result += ",";
+        }
+        result += std::to_string(values[i]);
+    }
+    return result + "]";
+}
+
+std::string Protocol::GetHelloAudioParams() const {
+    // The uplink stays 16 kHz mono, the downlink_* lists are hints for the server
+    std::string params = "\"audio_params\":{";
+    params += "\"format\":\"opus\", \"sample_rate\":16000, \"channels\":1, \"frame_duration\":" + std::to_string(uplink_frame_duration_);
+    if (!preferred_sample_rates_.empty()) {
+        params += ", \"downlink_sample_rates\":" + JoinNumbers(preferred_sample_rates_);
+    }
+    if (!preferred_frame_durations_.empty()) {
+        params += ", \"downlink_frame_durations\":" + JoinNumbers(preferred_frame_durations_);
+    }
+    params += "}";
+    return params;
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -40,6 +74,23 @@ void Protocol::SendAbortSpeaking(AbortReason reason) {
     SendText(message);
 }
 
+void Protocol::SendFlowControl(bool pause) {
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"flow\",\"state\":\"";
+    message += pause ? "pause" : "resume";
+    message += "\"}";
+    SendText(message);
+}
+
+void Protocol::PrewarmAudioChannel(int timeout_ms) {
+}
+
+void Protocol::SendAudioGap(int duration_ms) {
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"dtx\",\"gap_ms\":";
+    message += std::to_string(duration_ms);
+    message += "}";
+    SendText(message);
+}
+
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
     std::string json = "{\"session_id\":\"" + session_id_ + 
                       "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
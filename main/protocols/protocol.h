@@ -5,6 +5,7 @@
 #include <string>
 #include <functional>
 #include <chrono>
+#include <vector>
 
 struct BinaryProtocol3 {
     uint8_t type;
@@ -38,7 +39,14 @@ public:
         return session_id_;
     }
 
-    void OnIncomingAudio(std::function<void(std::vector<uint8_t>&& data)> callback);
+    // Downlink formats the device can play without extra work, most preferred
+    // first. They are offered in the hello message; servers that don't know
+    // them keep answering with their own defaults.
+    void SetPreferredDownlink(const std::vector<int>& sample_rates, const std::vector<int>& frame_durations);
+    // Duration of the Opus frames the device sends, announced in the hello message
+    void SetUplinkFrameDuration(int frame_duration);
+
+    void OnIncomingAudio(std::function<void(const uint8_t* data, size_t size)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
@@ -46,6 +54,10 @@ public:
 
     virtual void Start() = 0;
     virtual bool OpenAudioChannel() = 0;
+    // Starts the handshake of the next OpenAudioChannel() early, e.g. on button press-down.
+    // Never blocks; the speculative session is released if the channel is not opened
+    // within timeout_ms. Protocols without a separate handshake ignore it.
+    virtual void PrewarmAudioChannel(int timeout_ms);
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
     virtual bool IsAudioChannelBusy() const;
@@ -54,25 +66,33 @@ public:
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
     virtual void SendAbortSpeaking(AbortReason reason);
+    virtual void SendFlowControl(bool pause);
+    // Uplink audio left out before the next packet, e.g. silence suppressed by DTX
+    virtual void SendAudioGap(int duration_ms);
     virtual void SendIotDescriptors(const std::string& descriptors);
     virtual void SendIotStates(const std::string& states);
     virtual bool SendText(const std::string& text) = 0;
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
-    std::function<void(std::vector<uint8_t>&& data)> on_incoming_audio_;
+    std::function<void(const uint8_t* data, size_t size)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
     std::function<void(const std::string& message)> on_network_error_;
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int uplink_frame_duration_ = 60;
+    std::vector<int> preferred_sample_rates_;
+    std::vector<int> preferred_frame_durations_;
     bool error_occurred_ = false;
     bool busy_sending_audio_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
 
     virtual void SetError(const std::string& message);
+    // "audio_params":{...} member of the hello message
+    std::string GetHelloAudioParams() const;
     virtual bool IsTimeout() const;
 };
 
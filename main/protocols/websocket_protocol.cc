@@ -26,6 +26,7 @@ void WebsocketProtocol::Start() {
 }
 
 void WebsocketProtocol::SendAudio(const std::vector<uint8_t>& data) {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
     if (websocket_ == nullptr) {
         return;
     }
@@ -36,11 +37,16 @@ void WebsocketProtocol::SendAudio(const std::vector<uint8_t>& data) {
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
-    if (websocket_ == nullptr) {
-        return false;
+    bool sent;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (websocket_ == nullptr) {
+            return false;
+        }
+        sent = websocket_->Send(text);
     }
 
-    if (!websocket_->Send(text)) {
+    if (!sent) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
         return false;
@@ -50,10 +56,12 @@ bool WebsocketProtocol::SendText(const std::string& text) {
 }
 
 bool WebsocketProtocol::IsAudioChannelOpened() const {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
     return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
 }
 
 void WebsocketProtocol::CloseAudioChannel() {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
     if (websocket_ != nullptr) {
         delete websocket_;
         websocket_ = nullptr;
@@ -61,24 +69,24 @@ void WebsocketProtocol::CloseAudioChannel() {
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
-    if (websocket_ != nullptr) {
-        delete websocket_;
-    }
+    CloseAudioChannel();
 
     busy_sending_audio_ = false;
     error_occurred_ = false;
     std::string url = CONFIG_WEBSOCKET_URL;
     std::string token = "Bearer " + std::string(CONFIG_WEBSOCKET_ACCESS_TOKEN);
-    websocket_ = Board::GetInstance().CreateWebSocket();
-    websocket_->SetHeader("Authorization", token.c_str());
-    websocket_->SetHeader("Protocol-Version", "1");
-    websocket_->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
-    websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
-
-    websocket_->OnData([this](const char* data, size_t len, bool binary) {
+    // Set up and connected before it is published, so SendAudio() and CloseAudioChannel()
+    // on other tasks only ever see a ready socket
+    auto websocket = Board::GetInstance().CreateWebSocket();
+    websocket->SetHeader("Authorization", token.c_str());
+    websocket->SetHeader("Protocol-Version", "1");
+    websocket->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
+    websocket->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
+
+    websocket->OnData([this](const char* data, size_t len, bool binary) {
         if (binary) {
             if (on_incoming_audio_ != nullptr) {
-                on_incoming_audio_(std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len));
+                on_incoming_audio_((const uint8_t*)data, len);
             }
         } else {
             // Parse JSON data
@@ -100,28 +108,36 @@ bool WebsocketProtocol::OpenAudioChannel() {
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
-    websocket_->OnDisconnected([this]() {
+    websocket->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Websocket disconnected");
         if (on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
         }
     });
 
-    if (!websocket_->Connect(url.c_str())) {
+    if (!websocket->Connect(url.c_str())) {
         ESP_LOGE(TAG, "Failed to connect to websocket server");
+        delete websocket;
         SetError(Lang::Strings::SERVER_NOT_FOUND);
         return false;
     }
 
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (websocket_ != nullptr) {
+            delete websocket_;
+        }
+        websocket_ = websocket;
+    }
+
     // Send hello message to describe the client
     // keys: message type, version, audio_params (format, sample_rate, channels)
     std::string message = "{";
     message += "\"type\":\"hello\",";
     message += "\"version\": 1,";
     message += "\"transport\":\"websocket\",";
-    message += "\"audio_params\":{";
-    message += "\"format\":\"opus\", \"sample_rate\":16000, \"channels\":1, \"frame_duration\":" + std::to_string(OPUS_FRAME_DURATION_MS);
-    message += "}}";
+    message += GetHelloAudioParams();
+    message += "}";
     if (!SendText(message)) {
         return false;
     }
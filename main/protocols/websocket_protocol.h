@@ -7,6 +7,7 @@
 #include <web_socket.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <mutex>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
 
@@ -24,6 +25,8 @@ public:
 private:
     EventGroupHandle_t event_group_handle_;
     WebSocket* websocket_ = nullptr;
+    // Audio is sent from the uplink task, text from the main task
+    mutable std::mutex channel_mutex_;
 
     void ParseServerHello(const cJSON* root);
     bool SendText(const std::string& text) override;
@@ -0,0 +1,177 @@
+// Uplink packet encryption before and after sending from a reused buffer:
+// packets per second, heap allocations and bytes copied or filled besides the
+// encrypted payload itself. AES runs on OpenSSL here (see stubs/mbedtls/aes.h),
+// so only the difference between the two paths carries over to the target.
+#include "audio_cipher.h"
+
+#include <openssl/evp.h>
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+static size_t g_allocations = 0;
+static size_t g_allocated_bytes = 0;
+
+void* operator new(size_t size) {
+    g_allocations++;
+    g_allocated_bytes += size;
+    void* p = malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static const std::string kKey = "0123456789abcdef";
+static const std::string kNonce = std::string("\x01\x00\x00\x00\x12\x34\x56\x78\x9a\xbc\xde\xf0\x00\x00\x00\x00", 16);
+
+// MqttProtocol::SendAudio before: a nonce copy and a new datagram per packet
+class CopyingSender {
+public:
+    CopyingSender() {
+        mbedtls_aes_init(&ctx_);
+        mbedtls_aes_setkey_enc(&ctx_, (const unsigned char*)kKey.data(), 128);
+    }
+    ~CopyingSender() {
+        mbedtls_aes_free(&ctx_);
+    }
+
+    std::string Send(const std::vector<uint8_t>& data) {
+        std::string nonce(aes_nonce_);
+        copied_ += nonce.size();
+        *(uint16_t*)&nonce[2] = htons(data.size());
+        *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
+
+        std::string encrypted;
+        encrypted.resize(aes_nonce_.size() + data.size());
+        copied_ += encrypted.size();  // zero fill
+        memcpy(encrypted.data(), nonce.data(), nonce.size());
+        copied_ += nonce.size();
+
+        size_t nc_off = 0;
+        uint8_t stream_block[16] = {0};
+        mbedtls_aes_crypt_ctr(&ctx_, data.size(), &nc_off, (uint8_t*)nonce.data(), stream_block,
+            data.data(), (uint8_t*)&encrypted[nonce.size()]);
+        return encrypted;
+    }
+
+    size_t copied() const { return copied_; }
+
+private:
+    mbedtls_aes_context ctx_;
+    std::string aes_nonce_ = kNonce;
+    uint32_t local_sequence_ = 0;
+    size_t copied_ = 0;
+};
+
+// MqttProtocol::SendAudio now: header and payload written into send_buffer_
+class InPlaceSender {
+public:
+    InPlaceSender() {
+        cipher_.SetKey(kKey);
+        send_buffer_.reserve(AUDIO_CIPHER_HEADER_SIZE + 512);
+    }
+
+    const std::string& Send(const std::vector<uint8_t>& data) {
+        size_t size = AUDIO_CIPHER_HEADER_SIZE + data.size();
+        if (size > send_buffer_.size()) {
+            copied_ += size - send_buffer_.size();  // zero fill of the grown part
+        }
+        send_buffer_.resize(size);
+        uint8_t* packet = (uint8_t*)send_buffer_.data();
+        memcpy(packet, aes_nonce_.data(), AUDIO_CIPHER_HEADER_SIZE);
+        copied_ += AUDIO_CIPHER_HEADER_SIZE;
+        *(uint16_t*)&packet[2] = htons(data.size());
+        *(uint32_t*)&packet[12] = htonl(++local_sequence_);
+        // AudioCipher::Crypt copies the header into its counter block
+        copied_ += AUDIO_CIPHER_HEADER_SIZE;
+        cipher_.Crypt(packet, data.data(), packet + AUDIO_CIPHER_HEADER_SIZE, data.size());
+        return send_buffer_;
+    }
+
+    size_t copied() const { return copied_; }
+
+private:
+    AudioCipher cipher_;
+    std::string aes_nonce_ = kNonce;
+    std::string send_buffer_;
+    uint32_t local_sequence_ = 0;
+    size_t copied_ = 0;
+};
+
+// Both paths against an independent AES-128-CTR of the whole packet
+static void CheckAgainstOpenSsl(const std::string& datagram, const std::vector<uint8_t>& data) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    CHECK(EVP_EncryptInit_ex(ctx, EVP_aes_128_ctr(), nullptr, (const unsigned char*)kKey.data(),
+        (const unsigned char*)datagram.data()) == 1);
+    std::vector<uint8_t> expected(data.size());
+    int out_len = 0;
+    CHECK(EVP_EncryptUpdate(ctx, expected.data(), &out_len, data.data(), (int)data.size()) == 1);
+    EVP_CIPHER_CTX_free(ctx);
+    CHECK(memcmp(datagram.data() + AUDIO_CIPHER_HEADER_SIZE, expected.data(), expected.size()) == 0);
+}
+
+// Opus packets of a 60 ms uplink frame at 16 kHz vary around 100-200 bytes
+static std::vector<std::vector<uint8_t>> MakePackets() {
+    std::vector<std::vector<uint8_t>> packets;
+    for (int i = 0; i < 64; i++) {
+        packets.emplace_back(100 + (i * 37) % 100);
+        for (size_t j = 0; j < packets.back().size(); j++) {
+            packets.back()[j] = (uint8_t)(i * 13 + j);
+        }
+    }
+    return packets;
+}
+
+template <typename Sender>
+static void Run(const char* name, const std::vector<std::vector<uint8_t>>& packets) {
+    Sender sender;
+    CheckAgainstOpenSsl(sender.Send(packets[0]), packets[0]);
+    CheckAgainstOpenSsl(sender.Send(packets[1]), packets[1]);
+
+    const int rounds = 200000;
+    size_t payload = 0;
+    size_t copied = sender.copied();
+    size_t allocations = g_allocations;
+    size_t allocated_bytes = g_allocated_bytes;
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        auto& data = packets[i % packets.size()];
+        checksum += (uint8_t)sender.Send(data)[AUDIO_CIPHER_HEADER_SIZE];
+        payload += data.size();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-9s %8.0f packets/s  %5.2f allocs, %6.1f heap bytes, %5.1f bytes copied per packet (payload %zu, checksum %zu)\n",
+        name, rounds / seconds, (double)(g_allocations - allocations) / rounds,
+        (double)(g_allocated_bytes - allocated_bytes) / rounds, (double)(sender.copied() - copied) / rounds,
+        payload / rounds, checksum % 10);
+}
+
+int main() {
+    auto packets = MakePackets();
+    Run<CopyingSender>("copying", packets);
+    Run<InPlaceSender>("in place", packets);
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "loopback_audio_codec.h"
+#include "file_audio_codec.h"
+#include "audio_mixer.h"
+#include "pcm_interleave.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+static int16_t Ramp(size_t i) {
+    return (int16_t)((i * 37) % 20000 - 10000);
+}
+
+// Speaker audio mixed like AudioOutputTask does comes back as the reference
+// channel, and as a delayed, attenuated echo in the microphone channel
+static void TestLoopbackEcho() {
+    const int rate = 16000;
+    const size_t delay = rate * 20 / 1000;
+    LoopbackAudioCodec codec(rate, 20, 0.5f, 0);
+    codec.Start();
+    CHECK(codec.input_reference());
+    CHECK(codec.input_channels() == 2);
+
+    AudioMixer mixer(2, rate);
+    std::vector<int16_t> tone(960);
+    for (size_t i = 0; i < tone.size(); i++) {
+        tone[i] = Ramp(i);
+    }
+    mixer.voice(0).Write(tone.data(), tone.size());
+
+    std::vector<int16_t> speaker(tone.size());
+    CHECK(mixer.Mix(speaker.data(), speaker.size(), 100) == tone.size());
+    codec.OutputData(speaker);
+
+    std::vector<int16_t> near_end(tone.size(), 100);
+    CHECK(codec.FeedMic(near_end.data(), near_end.size()));
+
+    std::vector<int16_t> input(tone.size() * 2);
+    CHECK(codec.InputData(input));
+    std::vector<int16_t> mic(tone.size()), reference(tone.size());
+    int16_t* channels[] = { mic.data(), reference.data() };
+    DeinterleavePcm(input.data(), 2, channels, tone.size());
+
+    for (size_t i = 0; i < tone.size(); i++) {
+        CHECK(reference[i] == tone[i]);
+        int16_t echo = i < delay ? 0 : (int16_t)(tone[i - delay] * 0.5f);
+        CHECK(mic[i] == 100 + echo);
+    }
+}
+
+// Speed 1 is paced like real hardware
+static void TestLoopbackPacing() {
+    LoopbackAudioCodec codec(16000, 0, 0, 1.0f);
+    codec.Start();
+    std::vector<int16_t> input(16000 * 2 / 10);  // 100 ms of stereo
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 3; i++) {
+        CHECK(codec.InputData(input));
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    CHECK(elapsed >= 180 && elapsed < 1000);
+}
+
+// After a stall only what the DMA ring holds is written without waiting
+static void TestLoopbackStall() {
+    LoopbackAudioCodec codec(16000, 0, 0, 1.0f);
+    codec.Start();
+    std::vector<int16_t> chunk(16000 * 20 / 1000);
+    codec.OutputData(chunk);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 15; i++) {
+        codec.OutputData(chunk);
+    }
+    // 300 ms of audio, of which the ring takes 6 x 240 frames (90 ms) at once
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    CHECK(elapsed >= 180 && elapsed < 1000);
+}
+
+static void WriteWav(const std::string& path, int rate, int channels, const std::vector<int16_t>& samples) {
+    FILE* file = fopen(path.c_str(), "wb");
+    CHECK(file != nullptr);
+    uint32_t data_size = samples.size() * sizeof(int16_t);
+    uint32_t riff_size = 36 + data_size;
+    uint32_t format_size = 16;
+    uint16_t format[] = { 1, (uint16_t)channels };
+    uint32_t rates[] = { (uint32_t)rate, (uint32_t)(rate * channels * 2) };
+    uint16_t layout[] = { (uint16_t)(channels * 2), 16 };
+    fwrite("RIFF", 1, 4, file);
+    fwrite(&riff_size, 4, 1, file);
+    fwrite("WAVEfmt ", 1, 8, file);
+    fwrite(&format_size, 4, 1, file);
+    fwrite(format, 2, 2, file);
+    fwrite(rates, 4, 2, file);
+    fwrite(layout, 2, 2, file);
+    fwrite("data", 1, 4, file);
+    fwrite(&data_size, 4, 1, file);
+    fwrite(samples.data(), 2, samples.size(), file);
+    fclose(file);
+}
+
+// A stereo WAV plays as mic + reference, the speaker is recorded to a WAV
+static void TestFileCodec() {
+    std::string input_path = "audio_codec_test_in.wav";
+    std::string output_path = "audio_codec_test_out.wav";
+    std::vector<int16_t> samples(800 * 2);
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = Ramp(i);
+    }
+    WriteWav(input_path, 16000, 2, samples);
+
+    {
+        FileAudioCodec codec(input_path.c_str(), output_path.c_str(), 16000, 24000, 0);
+        codec.Start();
+        CHECK(codec.input_reference());
+        CHECK(codec.input_channels() == 2);
+
+        std::vector<int16_t> input(1000 * 2);
+        CHECK(codec.InputData(input));
+        CHECK(memcmp(input.data(), samples.data(), samples.size() * sizeof(int16_t)) == 0);
+        for (size_t i = samples.size(); i < input.size(); i++) {
+            CHECK(input[i] == 0);
+        }
+
+        std::vector<int16_t> speaker(480);
+        for (size_t i = 0; i < speaker.size(); i++) {
+            speaker[i] = Ramp(i * 3);
+        }
+        codec.OutputData(speaker);
+        codec.OutputData(speaker);
+    }
+
+    FILE* file = fopen(output_path.c_str(), "rb");
+    CHECK(file != nullptr);
+    uint8_t header[44];
+    CHECK(fread(header, 1, sizeof(header), file) == sizeof(header));
+    CHECK(memcmp(header, "RIFF", 4) == 0 && memcmp(header + 8, "WAVEfmt ", 8) == 0);
+    uint32_t sample_rate, data_size;
+    memcpy(&sample_rate, header + 24, 4);
+    memcpy(&data_size, header + 40, 4);
+    CHECK(sample_rate == 24000);
+    CHECK(data_size == 960 * sizeof(int16_t));
+    std::vector<int16_t> recorded(960);
+    CHECK(fread(recorded.data(), sizeof(int16_t), recorded.size(), file) == recorded.size());
+    fclose(file);
+    CHECK(recorded[480 + 7] == Ramp(7 * 3));
+
+    remove(input_path.c_str());
+    remove(output_path.c_str());
+}
+
+int main() {
+    TestLoopbackEcho();
+    TestLoopbackPacing();
+    TestLoopbackStall();
+    TestFileCodec();
+    printf("audio_codec_test passed\n");
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "audio_mixer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+using Clock = std::chrono::steady_clock;
+
+static long ElapsedMs(Clock::time_point start) {
+    return (long)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+// A sample written to any voice ends the wait right away, not on the next poll
+static void TestWakesOnAnyVoice() {
+    for (int index = 0; index < 2; index++) {
+        AudioMixer mixer(2, 320);
+        std::vector<int16_t> output(320);
+        std::thread writer([&mixer, index]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            std::vector<int16_t> pcm(160, 1000);
+            mixer.voice(index).Write(pcm.data(), pcm.size());
+        });
+        auto start = Clock::now();
+        size_t samples = mixer.Mix(output.data(), output.size(), 5000);
+        long elapsed = ElapsedMs(start);
+        writer.join();
+        CHECK(samples == 160);
+        CHECK(output[0] == 1000);
+        CHECK(elapsed >= 40 && elapsed < 1000);
+    }
+}
+
+static void TestTimeout() {
+    AudioMixer mixer(2, 320);
+    std::vector<int16_t> output(320);
+    auto start = Clock::now();
+    CHECK(mixer.Mix(output.data(), output.size(), 100) == 0);
+    long elapsed = ElapsedMs(start);
+    CHECK(elapsed >= 90 && elapsed < 1000);
+}
+
+static void TestWake() {
+    AudioMixer mixer(2, 320);
+    std::vector<int16_t> output(320);
+    std::thread waker([&mixer]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        mixer.Wake();
+    });
+    auto start = Clock::now();
+    CHECK(mixer.Mix(output.data(), output.size(), 5000) == 0);
+    long elapsed = ElapsedMs(start);
+    waker.join();
+    CHECK(elapsed >= 40 && elapsed < 1000);
+
+    // A wake while samples are queued does not hide them
+    std::vector<int16_t> pcm(160, 1000);
+    mixer.voice(0).Write(pcm.data(), pcm.size());
+    mixer.Wake();
+    CHECK(mixer.Mix(output.data(), output.size(), 100) == 160);
+}
+
+int main() {
+    TestWakesOnAnyVoice();
+    TestTimeout();
+    TestWake();
+    printf("audio_mixer_test passed\n");
+    return 0;
+}
@@ -0,0 +1,126 @@
+// Push/pop cost and hand-over latency of AudioPacketRing against the
+// std::list<std::vector<uint8_t>> + mutex queue it replaced for the downlink
+#include "audio_packet_ring.h"
+#include "latency_stats.h"
+
+#include <esp_timer.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A 60 ms Opus frame at the server bitrate
+#define PACKET_SIZE 180
+#define QUEUE_PACKETS 50
+
+// The old downlink queue: the network callback copied each packet into a new
+// vector and appended it under the application mutex, the decoder moved it out
+class ListQueue {
+public:
+    bool Push(const uint8_t* data, size_t size, int64_t timestamp) {
+        std::vector<uint8_t> packet(data, data + size);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (packets_.size() >= QUEUE_PACKETS) {
+            return false;
+        }
+        packets_.emplace_back(std::move(packet), timestamp);
+        cv_.notify_one();
+        return true;
+    }
+
+    bool Pop(std::vector<uint8_t>& packet, int timeout_ms, int64_t* timestamp) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() { return !packets_.empty(); })) {
+            return false;
+        }
+        packet = std::move(packets_.front().first);
+        *timestamp = packets_.front().second;
+        packets_.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::list<std::pair<std::vector<uint8_t>, int64_t>> packets_;
+};
+
+class RingQueue {
+public:
+    bool Push(const uint8_t* data, size_t size, int64_t timestamp) {
+        return ring_.Push(data, size, false, timestamp);
+    }
+
+    bool Pop(std::vector<uint8_t>& packet, int timeout_ms, int64_t* timestamp) {
+        return ring_.Pop(packet, timeout_ms, timestamp);
+    }
+
+private:
+    AudioPacketRing ring_{QUEUE_PACKETS, 1024, false};
+};
+
+// One push and one pop back to back on the same thread, the uncontended cost
+template <typename Queue>
+static double PushPopNs() {
+    Queue queue;
+    std::vector<uint8_t> data(PACKET_SIZE, 0x5a);
+    std::vector<uint8_t> packet;
+    int64_t timestamp;
+    const int rounds = 200000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        queue.Push(data.data(), data.size(), i);
+        queue.Pop(packet, 0, &timestamp);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+}
+
+// Producer thread pushing bursts like a network callback, consumer blocking in
+// Pop like the decode task. Latency is push to pop, in microseconds.
+template <typename Queue>
+static LatencyStats HandOver() {
+    Queue queue;
+    LatencyStats stats;
+    std::atomic<bool> done{false};
+    std::thread producer([&queue, &done]() {
+        std::vector<uint8_t> data(PACKET_SIZE, 0x5a);
+        for (int burst = 0; burst < 2000; burst++) {
+            for (int i = 0; i < 4; i++) {
+                while (!queue.Push(data.data(), data.size(), esp_timer_get_time())) {
+                    std::this_thread::yield();
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        done = true;
+    });
+
+    std::vector<uint8_t> packet;
+    int64_t timestamp;
+    while (true) {
+        if (queue.Pop(packet, 10, &timestamp)) {
+            stats.Add(esp_timer_get_time() - timestamp);
+        } else if (done) {
+            break;
+        }
+    }
+    producer.join();
+    return stats;
+}
+
+static void Report(const char* name, double push_pop_ns, const LatencyStats& stats) {
+    printf("%-16s push+pop %6.1f ns   hand-over n=%lu p50=%lld p95=%lld p99=%lld max=%lld us\n", name, push_pop_ns,
+        (unsigned long)stats.count(), (long long)stats.Percentile(50), (long long)stats.Percentile(95),
+        (long long)stats.Percentile(99), (long long)stats.max_us());
+}
+
+int main() {
+    Report("list + mutex", PushPopNs<ListQueue>(), HandOver<ListQueue>());
+    Report("AudioPacketRing", PushPopNs<RingQueue>(), HandOver<RingQueue>());
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include "audio_packet_ring.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+static void TestFifo() {
+    AudioPacketRing ring(4, 16, false);
+    std::vector<uint8_t> packet;
+    CHECK(ring.Empty());
+    CHECK(!ring.Pop(packet));
+
+    for (uint8_t i = 0; i < 4; i++) {
+        uint8_t data[3] = {i, i, i};
+        CHECK(ring.Push(data, i % 3 + 1, false, i * 10));
+    }
+    uint8_t extra = 0;
+    CHECK(!ring.Push(&extra, 1));
+    CHECK(ring.Size() == 4);
+
+    for (uint8_t i = 0; i < 4; i++) {
+        int64_t timestamp = -1;
+        CHECK(ring.Pop(packet, &timestamp));
+        CHECK(packet.size() == size_t(i % 3 + 1));
+        CHECK(packet[0] == i);
+        CHECK(timestamp == i * 10);
+    }
+    CHECK(ring.Empty());
+
+    // Empty packets mark lost frames and must survive the round trip
+    CHECK(ring.Push(nullptr, 0));
+    CHECK(ring.Pop(packet) && packet.empty());
+
+    uint8_t big[17] = {};
+    CHECK(!ring.Push(big, sizeof(big)));
+}
+
+static void TestWait() {
+    AudioPacketRing ring(2, 16, false);
+    CHECK(!ring.Wait(5));
+
+    std::thread producer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        uint8_t data = 7;
+        ring.Push(&data, 1);
+    });
+    CHECK(ring.Wait(1000));
+    // Waiting does not consume the packet
+    CHECK(ring.Size() == 1);
+    producer.join();
+}
+
+// Clear() on a full ring frees the slots even when no Pop follows
+static void TestClearFreesSlots() {
+    AudioPacketRing ring(4, 16, false);
+    uint8_t data = 1;
+    for (int i = 0; i < 4; i++) {
+        CHECK(ring.Push(&data, 1));
+    }
+    ring.Clear();
+    CHECK(ring.Empty());
+    for (int i = 0; i < 4; i++) {
+        data = 10 + i;
+        CHECK(ring.Push(&data, 1));
+    }
+    CHECK(!ring.Push(&data, 1));
+    CHECK(ring.Size() == 4);
+
+    std::vector<uint8_t> packet;
+    for (int i = 0; i < 4; i++) {
+        CHECK(ring.Pop(packet));
+        CHECK(packet[0] == 10 + i);
+    }
+    CHECK(!ring.Pop(packet));
+}
+
+// The wake word pre-roll keeps the last N packets by popping the oldest
+// before each push, on a ring one slot larger than N, and clears the ring
+// whenever detection restarts. Every push must land, also right after a
+// clear that found the ring at its limit.
+static void TestPreRollTrim() {
+    const size_t kLimit = 2000 / 20;
+    AudioPacketRing ring(kLimit + 1, 16, false);
+    std::vector<uint8_t> dropped;
+    uint8_t data = 0;
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 150; i++) {
+            while (ring.Size() >= kLimit) {
+                CHECK(ring.Pop(dropped));
+            }
+            CHECK(ring.Push(&data, 1));
+        }
+        CHECK(ring.Size() == kLimit);
+        ring.Clear();
+    }
+}
+
+// A producer blocked on a full ring resumes when another task clears it
+static void TestClearWakesBlockedProducer() {
+    AudioPacketRing ring(2, 16, false);
+    uint8_t data = 0;
+    CHECK(ring.Push(&data, 1));
+    CHECK(ring.Push(&data, 1));
+
+    std::atomic<bool> pushed{false};
+    std::thread producer([&]() {
+        uint8_t value = 42;
+        CHECK(ring.Push(&value, 1, true));
+        pushed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(!pushed);
+    ring.Clear();
+    producer.join();
+    CHECK(pushed);
+
+    std::vector<uint8_t> packet;
+    CHECK(ring.Pop(packet) && packet[0] == 42);
+    CHECK(ring.Empty());
+}
+
+// Every packet carries its sequence number in all of its bytes, so a slot
+// overwritten while the consumer copies it shows up as a torn packet
+static void TestConcurrentPushPopClear() {
+    const uint32_t kPackets = 200000;
+    AudioPacketRing ring(5, 64, false);
+    std::atomic<bool> done{false};
+
+    std::thread producer([&]() {
+        uint8_t data[64];
+        for (uint32_t i = 0; i < kPackets; i++) {
+            size_t size = 4 + i % 60;
+            for (size_t k = 0; k < size; k++) {
+                data[k] = (uint8_t)i;
+            }
+            ring.Push(data, size, true, i);
+        }
+        done = true;
+    });
+    std::thread clearer([&]() {
+        while (!done) {
+            ring.Clear();
+            std::this_thread::yield();
+        }
+    });
+
+    std::vector<uint8_t> packet;
+    int64_t last = -1;
+    uint32_t received = 0;
+    while (!done || !ring.Empty()) {
+        int64_t timestamp;
+        if (!ring.Pop(packet, 1, &timestamp)) {
+            continue;
+        }
+        CHECK(timestamp > last);
+        last = timestamp;
+        CHECK((int64_t)packet.size() == 4 + timestamp % 60);
+        for (uint8_t byte : packet) {
+            CHECK(byte == (uint8_t)timestamp);
+        }
+        received++;
+    }
+    producer.join();
+    clearer.join();
+    CHECK(received > 0);
+}
+
+int main() {
+    TestFifo();
+    TestWait();
+    TestClearFreesSlots();
+    TestPreRollTrim();
+    TestClearWakesBlockedProducer();
+    TestConcurrentPushPopClear();
+    printf("audio_packet_ring_test passed\n");
+    return 0;
+}
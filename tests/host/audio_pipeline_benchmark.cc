@@ -0,0 +1,359 @@
+// End-to-end audio latency against a stand-in server, with the stages Application
+// runs on the device: capture -> uplink PCM ring -> encode -> send queue -> wire,
+// and wire -> JitterBuffer -> decode ring -> decode + resample -> AudioMixer ->
+// codec. The codec is a real-time LoopbackAudioCodec and the network a link with
+// random delay and loss. Opus is not part of the host build, so encode and decode
+// stand in as copies: the numbers are queueing and scheduling latency, the CPU
+// time per frame comes from CONFIG_AUDIO_CODEC_BENCHMARK on the device.
+// Prints the same stats Application logs, in the same format.
+#include "loopback_audio_codec.h"
+#include "audio_packet_ring.h"
+#include "audio_mixer.h"
+#include "pcm_ring.h"
+#include "pcm_interleave.h"
+#include "polyphase_resampler.h"
+#include "jitter_buffer.h"
+#include "latency_stats.h"
+
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+// Server audio is 24 kHz, the codec runs at 16 kHz like most boards
+#define SERVER_SAMPLE_RATE 24000
+#define CODEC_SAMPLE_RATE 16000
+#define FRAME_DURATION_MS 60
+#define PACKET_SIZE 180
+#define RUN_MS 10000
+// Same sizes as Application and MqttProtocol without PSRAM and with the Kconfig defaults
+#define DOWNLINK_BUFFER_MS 300
+#define DECODE_AHEAD_MS 120
+#define UPLINK_PCM_BUFFER_MS 240
+#define JITTER_BUFFER_PACKETS 8
+// Frames the server sends at once when an answer starts, less than the decode ring holds
+#define ANSWER_BURST_PACKETS 3
+
+static void Print(const char* name, const LatencyStats& stats) {
+    printf("%-22s n=%lu avg=%.1f p50=%.1f p95=%.1f p99=%.1f max=%.1f ms\n", name, (unsigned long)stats.count(),
+        stats.average_us() / 1000.0, stats.Percentile(50) / 1000.0, stats.Percentile(95) / 1000.0,
+        stats.Percentile(99) / 1000.0, stats.max_us() / 1000.0);
+}
+
+// One direction of the network: every packet is held for a random delay and
+// handed out in arrival order, so a late packet can be overtaken
+class Link {
+public:
+    struct Packet {
+        uint32_t sequence;
+        std::vector<uint8_t> data;
+    };
+
+    explicit Link(uint32_t seed) : random_(seed) {}
+
+    void Send(uint32_t sequence, const uint8_t* data, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (loss_(random_) < 0.01) {
+            return;
+        }
+        // A few ms on a good Wi-Fi link, with the odd retransmission burst
+        double delay_ms = 5 + jitter_(random_);
+        if (loss_(random_) < 0.03) {
+            delay_ms += 80;
+        }
+        int64_t arrival = esp_timer_get_time() + (int64_t)(delay_ms * 1000);
+        in_flight_.emplace(arrival, Packet{ sequence, std::vector<uint8_t>(data, data + size) });
+        cv_.notify_one();
+    }
+
+    // Waits until a packet arrives or deadline_us passes
+    bool Receive(Packet& packet, int64_t deadline_us) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            int64_t now = esp_timer_get_time();
+            if (!in_flight_.empty() && in_flight_.begin()->first <= now) {
+                packet = std::move(in_flight_.begin()->second);
+                in_flight_.erase(in_flight_.begin());
+                return true;
+            }
+            int64_t wake = deadline_us;
+            if (!in_flight_.empty()) {
+                wake = std::min(wake, in_flight_.begin()->first);
+            }
+            if (now >= deadline_us) {
+                return false;
+            }
+            cv_.wait_for(lock, std::chrono::microseconds(wake - now));
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::multimap<int64_t, Packet> in_flight_;
+    std::mt19937 random_;
+    std::uniform_real_distribution<double> loss_{0, 1};
+    std::exponential_distribution<double> jitter_{1.0 / 8};
+};
+
+class Device {
+public:
+    Device() : codec_(CODEC_SAMPLE_RATE, 20, 0.5f, 1.0f), downlink_(1), jitter_buffer_(JITTER_BUFFER_PACKETS, 1024) {
+        codec_.Start();
+        jitter_buffer_.Reset(FRAME_DURATION_MS);
+    }
+
+    void Run() {
+        std::vector<std::thread> threads;
+        threads.emplace_back([this]() { ServerTask(); });
+        threads.emplace_back([this]() { ReceiveTask(); });
+        threads.emplace_back([this]() { DecodeTask(); });
+        threads.emplace_back([this]() { OutputTask(); });
+        threads.emplace_back([this]() { CaptureTask(); });
+        threads.emplace_back([this]() { EncodeTask(); });
+        threads.emplace_back([this]() { SendTask(); });
+
+        // The user talks over every answer after 800 ms. The server starts the next
+        // answer 200 ms later, which clears aborted_ like a tts start does.
+        for (int elapsed = 0; elapsed < RUN_MS; elapsed += 1000) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(800));
+            AbortSpeaking();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            aborted_ = false;
+            new_answer_ = true;
+        }
+
+        running_ = false;
+        mixer_.Wake();
+        mixer_.voice(0).Clear();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        Print("Uplink capture backlog", capture_backlog_stats_);
+        Print("Mic to wire", mic_to_wire_stats_);
+        Print("Jitter buffer hold", hold_stats_);
+        Print("Wire to speaker", wire_stats_);
+        Print("Barge-in to silence", barge_in_stats_);
+        printf("Jitter buffer: lost %lu, late %lu, reordered %lu, jitter %d us, decode ring dropped %lu\n",
+            (unsigned long)jitter_buffer_.lost_packets(), (unsigned long)jitter_buffer_.late_packets(),
+            (unsigned long)jitter_buffer_.reordered_packets(), jitter_buffer_.jitter_us(),
+            (unsigned long)downlink_dropped_);
+
+        CHECK(wire_stats_.count() > 0 && barge_in_stats_.count() > 0);
+        // Nearly every uplink frame was sent, the capture path kept up with real time
+        CHECK(mic_to_wire_stats_.count() >= RUN_MS / FRAME_DURATION_MS * 9 / 10);
+    }
+
+private:
+    LoopbackAudioCodec codec_;
+    Link downlink_;
+    JitterBuffer jitter_buffer_;
+    AudioPacketRing decode_queue_{DOWNLINK_BUFFER_MS / FRAME_DURATION_MS, 1024, false};
+    AudioMixer mixer_{2, CODEC_SAMPLE_RATE * DECODE_AHEAD_MS / 1000};
+    PcmRing uplink_pcm_ring_{16000 * UPLINK_PCM_BUFFER_MS / 1000};
+    AudioPacketRing uplink_send_queue_{480 / FRAME_DURATION_MS, 512, false};
+
+    std::atomic<bool> running_{true};
+    std::atomic<bool> aborted_{false};
+    std::atomic<bool> new_answer_{true};
+    std::atomic<bool> decode_in_flight_{false};
+    std::atomic<int64_t> abort_time_us_{0};
+    std::atomic<uint32_t> downlink_dropped_{0};
+
+    // Each stat is only touched by one task, and read once they have all stopped
+    LatencyStats capture_backlog_stats_;
+    LatencyStats mic_to_wire_stats_;
+    LatencyStats hold_stats_;
+    LatencyStats wire_stats_;
+    LatencyStats barge_in_stats_;
+
+    void AbortSpeaking() {
+        abort_time_us_ = esp_timer_get_time();
+        mixer_.Wake();
+        aborted_ = true;
+        decode_queue_.Clear();
+    }
+
+    // Streams one packet per frame. Each answer starts with a burst that fills the
+    // decode ring, like the TTS server sends ahead of real time.
+    void ServerTask() {
+        std::vector<uint8_t> packet(PACKET_SIZE);
+        auto next = std::chrono::steady_clock::now();
+        for (uint32_t sequence = 1; running_; sequence++) {
+            if (new_answer_.exchange(false)) {
+                next = std::chrono::steady_clock::now() - std::chrono::milliseconds(FRAME_DURATION_MS * ANSWER_BURST_PACKETS);
+            }
+            memcpy(packet.data(), &sequence, sizeof(sequence));
+            downlink_.Send(sequence, packet.data(), packet.size());
+            next += std::chrono::milliseconds(FRAME_DURATION_MS);
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    // The UDP receive callback and the jitter timer of MqttProtocol
+    void ReceiveTask() {
+        // MqttProtocol's OnIncomingAudio as Application sets it up, plus the time each
+        // packet waited in the jitter buffer
+        std::map<uint32_t, int64_t> arrivals;
+        jitter_buffer_.OnOutput([this, &arrivals](const uint8_t* data, size_t size) {
+            int64_t now = esp_timer_get_time();
+            uint32_t sequence;
+            if (size >= sizeof(sequence)) {
+                memcpy(&sequence, data, sizeof(sequence));
+                auto it = arrivals.find(sequence);
+                if (it != arrivals.end()) {
+                    hold_stats_.Add(now - it->second);
+                    arrivals.erase(arrivals.begin(), std::next(it));
+                }
+            }
+            if (decode_queue_.Size() * FRAME_DURATION_MS >= DOWNLINK_BUFFER_MS ||
+                !decode_queue_.Push(data, size, false, now)) {
+                downlink_dropped_++;
+            }
+        });
+
+        Link::Packet packet;
+        while (running_) {
+            int64_t deadline = jitter_buffer_.NextDeadline();
+            if (deadline < 0) {
+                deadline = esp_timer_get_time() + 100000;
+            }
+            if (downlink_.Receive(packet, deadline)) {
+                int64_t now = esp_timer_get_time();
+                arrivals[packet.sequence] = now;
+                uint8_t* slot = jitter_buffer_.Reserve(packet.sequence, packet.data.size(), now);
+                if (slot != nullptr) {
+                    memcpy(slot, packet.data.data(), packet.data.size());
+                    jitter_buffer_.Commit(packet.sequence, packet.data.size(), now);
+                }
+            }
+            jitter_buffer_.Poll(esp_timer_get_time());
+        }
+    }
+
+    // Application::AudioDecodeTask, with a tone standing in for the Opus decoder
+    void DecodeTask() {
+        PolyphaseResampler<2, 3, 48> resampler;
+        std::vector<uint8_t> opus;
+        std::vector<int16_t> pcm(SERVER_SAMPLE_RATE * FRAME_DURATION_MS / 1000);
+        std::vector<int16_t> resampled;
+        int64_t arrival_time = 0;
+        uint32_t phase = 0;
+
+        while (running_) {
+            decode_in_flight_ = false;
+            if (!decode_queue_.Wait(1000)) {
+                continue;
+            }
+            decode_in_flight_ = true;
+            if (!decode_queue_.Pop(opus, &arrival_time)) {
+                continue;
+            }
+            if (aborted_) {
+                continue;
+            }
+            // An empty packet is a lost frame, concealment still produces a full frame
+            for (auto& sample : pcm) {
+                sample = (int16_t)(8000 * sin(2 * M_PI * 440 * phase++ / SERVER_SAMPLE_RATE));
+            }
+            resampled.resize(resampler.GetOutputSamples(pcm.size()));
+            resampler.Process(pcm.data(), pcm.size(), resampled.data());
+
+            auto& stream = mixer_.voice(0);
+            stream.Write(resampled.data(), resampled.size());
+            int64_t queued_us = (int64_t)(stream.Size() - std::min(stream.Size(), resampled.size()))
+                * 1000000 / CODEC_SAMPLE_RATE;
+            wire_stats_.Add(esp_timer_get_time() - arrival_time + queued_us);
+        }
+    }
+
+    // Application::AudioOutputTask
+    void OutputTask() {
+        const size_t chunk_samples = CODEC_SAMPLE_RATE * 20 / 1000;
+        std::vector<int16_t> pcm(chunk_samples);
+        while (running_) {
+            pcm.resize(chunk_samples);
+            size_t samples = mixer_.Mix(pcm.data(), pcm.size(), 1000);
+            if (samples == 0) {
+                abort_time_us_ = 0;
+                continue;
+            }
+            pcm.resize(samples);
+            codec_.OutputData(pcm);
+
+            int64_t abort_time = abort_time_us_;
+            if (abort_time != 0 && mixer_.voice(0).Empty()) {
+                abort_time_us_ = 0;
+                barge_in_stats_.Add(esp_timer_get_time() - abort_time);
+            }
+        }
+    }
+
+    // Application::AudioLoop without a front end: 30 ms reads, the mic channel
+    // goes to the uplink ring
+    void CaptureTask() {
+        const size_t frames = CODEC_SAMPLE_RATE * 30 / 1000;
+        std::vector<int16_t> input(frames * 2);
+        std::vector<int16_t> mic(frames), reference(frames);
+        int16_t* channels[] = { mic.data(), reference.data() };
+        while (running_) {
+            CHECK(codec_.InputData(input));
+            DeinterleavePcm(input.data(), 2, channels, frames);
+            uplink_pcm_ring_.TryWrite(mic.data(), mic.size());
+        }
+    }
+
+    // Application::AudioEncodeTask, the packet carries the frame's first samples
+    void EncodeTask() {
+        std::vector<int16_t> pcm;
+        while (running_) {
+            pcm.resize(16000 * FRAME_DURATION_MS / 1000);
+            size_t samples = uplink_pcm_ring_.Read(pcm.data(), pcm.size(), 1000);
+            if (samples == 0) {
+                continue;
+            }
+            int64_t now = esp_timer_get_time();
+            int64_t backlog_us = (int64_t)uplink_pcm_ring_.Size() * 1000000 / 16000;
+            uplink_send_queue_.Push((const uint8_t*)pcm.data(), std::min<size_t>(PACKET_SIZE, samples * 2),
+                false, now - backlog_us);
+            capture_backlog_stats_.Add(backlog_us);
+        }
+    }
+
+    // Application::AudioSendTask, handing the packet to the server counts as on the wire
+    void SendTask() {
+        std::vector<uint8_t> opus;
+        int64_t capture_time = 0;
+        while (running_) {
+            if (!uplink_send_queue_.Pop(opus, 1000, &capture_time)) {
+                continue;
+            }
+            mic_to_wire_stats_.Add(esp_timer_get_time() - capture_time);
+        }
+    }
+};
+
+int main() {
+    Device device;
+    device.Run();
+    return 0;
+}
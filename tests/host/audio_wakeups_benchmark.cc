@@ -0,0 +1,220 @@
+// Wakeups per second of the capture, decode and output loops while idle and
+// while an answer plays. Polling is how they waited before: 30 ms delays, 100 ms
+// ring waits and 10 ms mixer slices. Blocking is what Application does now:
+// task notifications, 1 s ring waits and AudioMixer::Mix sleeping on its voices.
+#include "audio_packet_ring.h"
+#include "audio_mixer.h"
+
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+#define SAMPLE_RATE 16000
+// Downlink Opus frames and the output task's mix chunk
+#define PACKET_MS 60
+#define CHUNK_MS 20
+#define WINDOW_MS 2000
+
+// Stand-in for ulTaskNotifyTake / xTaskNotifyGive
+class Notification {
+public:
+    void Give() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = true;
+        cv_.notify_one();
+    }
+
+    bool Take(int timeout_ms) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        bool given = cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() { return pending_; });
+        pending_ = false;
+        return given;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool pending_ = false;
+};
+
+enum class Mode { Polling, Blocking };
+
+struct Scenario {
+    const char* name;
+    bool output_enabled;
+    bool playing;
+};
+
+struct Wakeups {
+    double capture;
+    double decode;
+    double output;
+};
+
+class Pipeline {
+public:
+    Pipeline(Mode mode, const Scenario& scenario) : mode_(mode), scenario_(scenario) {}
+
+    Wakeups Run() {
+        output_enabled_ = scenario_.output_enabled;
+        std::thread capture([this]() { CaptureLoop(); });
+        std::thread decode([this]() { DecodeLoop(); });
+        std::thread output([this]() { OutputLoop(); });
+        std::thread server;
+        if (scenario_.playing) {
+            server = std::thread([this]() { ServerLoop(); });
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(WINDOW_MS));
+        Wakeups wakeups = {
+            capture_wakeups_ * 1000.0 / WINDOW_MS,
+            decode_wakeups_ * 1000.0 / WINDOW_MS,
+            output_wakeups_ * 1000.0 / WINDOW_MS,
+        };
+
+        running_ = false;
+        capture_notification_.Give();
+        decode_notification_.Give();
+        mixer_.Wake();
+        if (server.joinable()) {
+            server.join();
+        }
+        capture.join();
+        output.join();
+        // Unblocks a decoder waiting for room in the stream voice
+        mixer_.voice(0).Clear();
+        decode.join();
+
+        if (scenario_.playing) {
+            // Most of the window reached the speaker, so the blocking loops did not starve it
+            CHECK(played_samples_ > SAMPLE_RATE * WINDOW_MS / 1000 / 2);
+        }
+        return wakeups;
+    }
+
+private:
+    Mode mode_;
+    Scenario scenario_;
+    std::atomic<bool> running_{true};
+    std::atomic<bool> output_enabled_{false};
+    std::atomic<uint32_t> capture_wakeups_{0};
+    std::atomic<uint32_t> decode_wakeups_{0};
+    std::atomic<uint32_t> output_wakeups_{0};
+    std::atomic<size_t> played_samples_{0};
+    Notification capture_notification_;
+    Notification decode_notification_;
+    AudioPacketRing packets_{50, 1024, false};
+    AudioMixer mixer_{2, SAMPLE_RATE * 120 / 1000};
+
+    // No consumer wants input in any of the scenarios
+    void CaptureLoop() {
+        while (running_) {
+            capture_wakeups_++;
+            if (mode_ == Mode::Polling) {
+                vTaskDelay(30);
+            } else {
+                capture_notification_.Take(1000);
+            }
+        }
+    }
+
+    void DecodeLoop() {
+        std::vector<uint8_t> opus;
+        std::vector<int16_t> pcm(SAMPLE_RATE * PACKET_MS / 1000, 1000);
+        while (running_) {
+            decode_wakeups_++;
+            if (!output_enabled_) {
+                if (mode_ == Mode::Polling) {
+                    vTaskDelay(30);
+                } else {
+                    decode_notification_.Take(1000);
+                }
+                continue;
+            }
+            if (!packets_.Wait(mode_ == Mode::Polling ? 100 : 1000)) {
+                continue;
+            }
+            if (!packets_.Pop(opus)) {
+                continue;
+            }
+            // Blocks while the stream voice is full, like the real decoder
+            mixer_.voice(0).Write(pcm.data(), pcm.size());
+        }
+    }
+
+    void OutputLoop() {
+        std::vector<int16_t> chunk(SAMPLE_RATE * CHUNK_MS / 1000);
+        while (running_) {
+            size_t samples;
+            if (mode_ == Mode::Polling) {
+                samples = PollingMix(chunk.data(), chunk.size(), 100);
+            } else {
+                output_wakeups_++;
+                samples = mixer_.Mix(chunk.data(), chunk.size(), 1000);
+            }
+            if (samples > 0) {
+                // The codec write blocks on the I2S DMA for the length of the chunk
+                std::this_thread::sleep_for(std::chrono::microseconds((int64_t)samples * 1000000 / SAMPLE_RATE));
+                played_samples_ += samples;
+            }
+        }
+    }
+
+    // AudioMixer::Mix before it slept on its voices: only the first voice was
+    // waited on, in 10 ms slices, each of which woke the output task
+    size_t PollingMix(int16_t* output, size_t max_samples, int timeout_ms) {
+        std::vector<int16_t> other(max_samples);
+        for (int waited = 0; ; waited += 10) {
+            output_wakeups_++;
+            size_t mixed = mixer_.voice(0).Read(output, max_samples, std::min(10, timeout_ms - waited));
+            mixed = std::max(mixed, mixer_.voice(1).Read(other.data(), max_samples, 0));
+            if (mixed > 0 || waited + 10 >= timeout_ms || !running_) {
+                return mixed;
+            }
+        }
+    }
+
+    // The server sends one packet per frame, the network callback pushes it
+    void ServerLoop() {
+        std::vector<uint8_t> packet(180, 0x5a);
+        auto next = std::chrono::steady_clock::now();
+        while (running_) {
+            packets_.Push(packet.data(), packet.size());
+            next += std::chrono::milliseconds(PACKET_MS);
+            std::this_thread::sleep_until(next);
+        }
+    }
+};
+
+int main() {
+    const Scenario scenarios[] = {
+        { "idle, speaker off", false, false },
+        { "idle, speaker on", true, false },
+        { "playing", true, true },
+    };
+    printf("Wakeups/s over %d ms          capture  decode  output\n", WINDOW_MS);
+    for (auto& scenario : scenarios) {
+        for (Mode mode : { Mode::Polling, Mode::Blocking }) {
+            Pipeline pipeline(mode, scenario);
+            Wakeups wakeups = pipeline.Run();
+            printf("%-18s %-9s %8.1f %7.1f %7.1f\n", scenario.name, mode == Mode::Polling ? "polling" : "blocking",
+                wakeups.capture, wakeups.decode, wakeups.output);
+        }
+    }
+    return 0;
+}
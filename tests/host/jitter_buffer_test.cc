@@ -0,0 +1,98 @@
+#include "jitter_buffer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+// Output sequence numbers, -1 for a concealed frame
+struct Output {
+    std::vector<int> packets;
+
+    void Attach(JitterBuffer& buffer) {
+        buffer.OnOutput([this](const uint8_t* data, size_t size) {
+            packets.push_back(size > 0 ? data[0] : -1);
+        });
+    }
+};
+
+static void Push(JitterBuffer& buffer, uint32_t sequence, int64_t now_us) {
+    uint8_t data = (uint8_t)sequence;
+    buffer.Push(sequence, &data, 1, now_us);
+}
+
+static void TestInOrderAndReordered() {
+    JitterBuffer buffer(8, 16);
+    Output output;
+    output.Attach(buffer);
+    buffer.Reset(60);
+
+    Push(buffer, 1, 0);
+    Push(buffer, 2, 60000);
+    Push(buffer, 4, 120000);
+    CHECK(output.packets == std::vector<int>({1, 2}));
+    CHECK(buffer.NextDeadline() > 120000);
+    Push(buffer, 3, 125000);
+    CHECK(output.packets == std::vector<int>({1, 2, 3, 4}));
+    CHECK(buffer.reordered_packets() == 1);
+    CHECK(buffer.NextDeadline() < 0);
+}
+
+static void TestGapConcealed() {
+    JitterBuffer buffer(8, 16);
+    Output output;
+    output.Attach(buffer);
+    buffer.Reset(60);
+
+    Push(buffer, 1, 0);
+    Push(buffer, 3, 60000);
+    int64_t deadline = buffer.NextDeadline();
+    CHECK(deadline > 60000);
+    buffer.Poll(deadline);
+    CHECK(output.packets == std::vector<int>({1, -1, 3}));
+    CHECK(buffer.lost_packets() == 1);
+
+    // The missing packet arriving afterwards is late
+    Push(buffer, 2, deadline + 1000);
+    CHECK(buffer.late_packets() == 1);
+    CHECK(output.packets.size() == 3);
+}
+
+// Timestamps come from esp_timer_get_time(), which passes INT32_MAX us
+// after ~36 minutes, and sessions can pause for a long time between turns
+static void TestEstimatorOnLongRunningClock() {
+    JitterBuffer buffer(8, 16);
+    Output output;
+    output.Attach(buffer);
+    buffer.Reset(60);
+
+    int64_t now = 40LL * 60 * 1000000;
+    uint32_t sequence = 1;
+    for (int i = 0; i < 50; i++, sequence++, now += 60000) {
+        Push(buffer, sequence, now);
+    }
+    CHECK(buffer.jitter_us() >= 0 && buffer.jitter_us() < 1000);
+
+    now += 3600LL * 1000000;
+    for (int i = 0; i < 50; i++, sequence++, now += 60000) {
+        Push(buffer, sequence, now);
+    }
+    CHECK(buffer.jitter_us() >= 0 && buffer.jitter_us() < 60000);
+    CHECK(buffer.gap_wait_us() >= 10000 && buffer.gap_wait_us() <= 180000);
+    CHECK(output.packets.size() == 100);
+    CHECK(buffer.lost_packets() == 0);
+}
+
+int main() {
+    TestInOrderAndReordered();
+    TestGapConcealed();
+    TestEstimatorOnLongRunningClock();
+    printf("jitter_buffer_test passed\n");
+    return 0;
+}
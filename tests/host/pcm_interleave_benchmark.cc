@@ -0,0 +1,111 @@
+// Cost per capture frame of DeinterleavePcm / InterleavePcm against the plain
+// per-sample loops ReadAudio used before, for 1, 2 and 4 channels
+#include "pcm_interleave.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+// 30 ms at 16 kHz, the capture frame the audio loop reads
+#define FRAMES 480
+#define ROUNDS 20000
+
+// Cycle counter where there is one, nanoseconds otherwise
+static inline uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+__attribute__((noinline)) static void DeinterleaveLoop(const int16_t* input, int channels, int16_t* const* outputs, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            outputs[c][i] = input[i * channels + c];
+        }
+    }
+}
+
+__attribute__((noinline)) static void InterleaveLoop(const int16_t* const* inputs, int channels, int16_t* output, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            output[i * channels + c] = inputs[c][i];
+        }
+    }
+}
+
+template <typename Function>
+static double PerFrame(Function function) {
+    uint64_t best = UINT64_MAX;
+    // Best of several batches, so a preemption does not skew the result
+    for (int batch = 0; batch < 10; batch++) {
+        uint64_t start = Now();
+        for (int i = 0; i < ROUNDS / 10; i++) {
+            function();
+            // Keeps the compiler from dropping repeated copies of the same data
+            asm volatile("" ::: "memory");
+        }
+        uint64_t elapsed = Now() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+    return (double)best / (ROUNDS / 10);
+}
+
+static void Run(int channels) {
+    std::vector<int16_t> interleaved(FRAMES * channels);
+    for (size_t i = 0; i < interleaved.size(); i++) {
+        interleaved[i] = (int16_t)(i * 31 - 7000);
+    }
+    std::vector<std::vector<int16_t>> planes(channels, std::vector<int16_t>(FRAMES));
+    std::vector<std::vector<int16_t>> expected(channels, std::vector<int16_t>(FRAMES));
+    std::vector<int16_t*> outputs(channels), expected_outputs(channels);
+    std::vector<const int16_t*> inputs(channels);
+    for (int c = 0; c < channels; c++) {
+        outputs[c] = planes[c].data();
+        expected_outputs[c] = expected[c].data();
+        inputs[c] = planes[c].data();
+    }
+    std::vector<int16_t> merged(interleaved.size());
+
+    // Same result as the loops before timing them
+    DeinterleaveLoop(interleaved.data(), channels, expected_outputs.data(), FRAMES);
+    DeinterleavePcm(interleaved.data(), channels, outputs.data(), FRAMES);
+    for (int c = 0; c < channels; c++) {
+        CHECK(planes[c] == expected[c]);
+    }
+    InterleavePcm(inputs.data(), channels, merged.data(), FRAMES);
+    CHECK(merged == interleaved);
+
+    double split_loop = PerFrame([&]() { DeinterleaveLoop(interleaved.data(), channels, outputs.data(), FRAMES); });
+    double split = PerFrame([&]() { DeinterleavePcm(interleaved.data(), channels, outputs.data(), FRAMES); });
+    double merge_loop = PerFrame([&]() { InterleaveLoop(inputs.data(), channels, merged.data(), FRAMES); });
+    double merge = PerFrame([&]() { InterleavePcm(inputs.data(), channels, merged.data(), FRAMES); });
+    printf("%d ch: deinterleave %7.0f -> %7.0f, interleave %7.0f -> %7.0f\n",
+        channels, split_loop, split, merge_loop, merge);
+}
+
+int main() {
+#if defined(__x86_64__) || defined(__i386__)
+    printf("TSC cycles per %d-frame buffer, plain loop -> kernel\n", FRAMES);
+#else
+    printf("Nanoseconds per %d-frame buffer, plain loop -> kernel\n", FRAMES);
+#endif
+    Run(1);
+    Run(2);
+    Run(4);
+    return 0;
+}
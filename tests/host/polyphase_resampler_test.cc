@@ -0,0 +1,222 @@
+#include "polyphase_resampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        exit(1); \
+    } \
+} while (0)
+
+// The five pairs AudioResampler runs on PolyphaseResampler
+struct Ratio {
+    int input_rate;
+    int output_rate;
+    int up;
+    int down;
+    int taps_per_phase;
+    std::unique_ptr<FixedRatioResampler> (*create)();
+};
+
+template <int Up, int Down, int TapsPerPhase>
+static std::unique_ptr<FixedRatioResampler> Create() {
+    return std::make_unique<PolyphaseResampler<Up, Down, TapsPerPhase>>();
+}
+
+static const Ratio kRatios[] = {
+    { 24000, 16000, 2, 3, 48, Create<2, 3, 48> },
+    { 48000, 16000, 1, 3, 96, Create<1, 3, 96> },
+    { 16000, 24000, 3, 2, 32, Create<3, 2, 32> },
+    { 24000, 48000, 2, 1, 32, Create<2, 1, 32> },
+    { 16000, 48000, 3, 1, 32, Create<3, 1, 32> },
+};
+
+// Two seconds of a tone, resampled in 20 ms chunks like the audio tasks do.
+// The first second lets the filter settle, the second is returned.
+static std::vector<double> Resample(const Ratio& ratio, FixedRatioResampler& resampler, double frequency, double amplitude) {
+    const size_t chunk = ratio.input_rate / 50;
+    std::vector<int16_t> input(chunk);
+    std::vector<int16_t> output;
+    std::vector<double> result;
+    for (size_t start = 0; start < (size_t)ratio.input_rate * 2; start += chunk) {
+        for (size_t i = 0; i < chunk; i++) {
+            input[i] = (int16_t)lround(amplitude * 32767 * sin(2 * M_PI * frequency * (start + i) / ratio.input_rate));
+        }
+        output.resize(resampler.GetOutputSamples(chunk));
+        resampler.Process(input.data(), chunk, output.data());
+        result.insert(result.end(), output.begin(), output.end());
+    }
+    CHECK(result.size() == (size_t)ratio.output_rate * 2);
+    return std::vector<double>(result.begin() + ratio.output_rate, result.end());
+}
+
+// Least squares fit of a tone at `frequency`, over whole periods since the
+// signal is one second long and the frequency a whole number of Hz
+struct ToneFit {
+    double amplitude;
+    double snr_db;
+};
+
+static ToneFit FitTone(const std::vector<double>& signal, int rate, double frequency) {
+    double a = 0, b = 0;
+    for (size_t n = 0; n < signal.size(); n++) {
+        a += signal[n] * cos(2 * M_PI * frequency * n / rate);
+        b += signal[n] * sin(2 * M_PI * frequency * n / rate);
+    }
+    a *= 2.0 / signal.size();
+    b *= 2.0 / signal.size();
+    double tone_power = 0, residual_power = 0;
+    for (size_t n = 0; n < signal.size(); n++) {
+        double fit = a * cos(2 * M_PI * frequency * n / rate) + b * sin(2 * M_PI * frequency * n / rate);
+        tone_power += fit * fit;
+        residual_power += (signal[n] - fit) * (signal[n] - fit);
+    }
+    return { sqrt(a * a + b * b) / 32767, 10 * log10(tone_power / std::max(residual_power, 1e-9)) };
+}
+
+static double ToDb(double gain) {
+    return 20 * log10(std::max(gain, 1e-9));
+}
+
+// A 1 kHz tone at half scale comes through clean
+static void TestSnr(const Ratio& ratio) {
+    auto resampler = ratio.create();
+    auto output = Resample(ratio, *resampler, 1000, 0.5);
+    auto fit = FitTone(output, ratio.output_rate, 1000);
+    printf("%5d -> %5d: SNR %.1f dB\n", ratio.input_rate, ratio.output_rate, fit.snr_db);
+    CHECK(fit.snr_db > 70);
+    CHECK(fabs(ToDb(fit.amplitude / 0.5)) < 0.1);
+}
+
+// Flat to 3/4 of the lower Nyquist rate, 6 kHz when either side is 16k
+static void TestPassband(const Ratio& ratio) {
+    int nyquist = std::min(ratio.input_rate, ratio.output_rate) / 2;
+    double worst = 0;
+    for (int frequency = 100; frequency <= nyquist * 3 / 4; frequency += 500) {
+        auto resampler = ratio.create();
+        auto fit = FitTone(Resample(ratio, *resampler, frequency, 0.5), ratio.output_rate, frequency);
+        double gain_db = ToDb(fit.amplitude / 0.5);
+        worst = std::max(worst, fabs(gain_db));
+    }
+    printf("%5d -> %5d: passband ripple %.3f dB up to %d Hz\n", ratio.input_rate, ratio.output_rate, worst, nyquist * 3 / 4);
+    CHECK(worst < 0.5);
+}
+
+// Downsampling: a tone above the output Nyquist rate must not fold back into the band.
+// Upsampling: the image of an input tone mirrored at the input Nyquist rate must be gone.
+static void TestAliasing(const Ratio& ratio) {
+    double input_frequency, leak_frequency;
+    if (ratio.output_rate < ratio.input_rate) {
+        int output_nyquist = ratio.output_rate / 2;
+        input_frequency = output_nyquist + ratio.input_rate / 8;
+        leak_frequency = ratio.output_rate - input_frequency;
+        while (leak_frequency < 0) {
+            leak_frequency += ratio.output_rate;
+        }
+    } else {
+        input_frequency = ratio.input_rate * 3 / 16;
+        leak_frequency = ratio.input_rate - input_frequency;
+        if (leak_frequency > ratio.output_rate / 2) {
+            leak_frequency = ratio.output_rate - leak_frequency;
+        }
+    }
+    auto resampler = ratio.create();
+    auto output = Resample(ratio, *resampler, input_frequency, 0.5);
+    auto leak = FitTone(output, ratio.output_rate, leak_frequency);
+    double leak_db = ToDb(leak.amplitude / 0.5);
+    printf("%5d -> %5d: %.0f Hz leaks %.1f dB at %.0f Hz\n", ratio.input_rate, ratio.output_rate,
+        input_frequency, leak_db, leak_frequency);
+    CHECK(leak_db < -60);
+}
+
+// Same filter, ratio and taps taken at run time, the way a generic FIR
+// resampler is written, to show what the template specialization buys
+class GenericResampler {
+public:
+    GenericResampler(int up, int down, int taps_per_phase)
+        : up_(up), down_(down), taps_per_phase_(taps_per_phase), phases_(up * taps_per_phase),
+          history_(taps_per_phase - 1, 0) {
+        std::vector<int16_t> prototype(up * taps_per_phase);
+        DesignPolyphaseFilter(up, down, up * taps_per_phase, prototype.data());
+        for (int phase = 0; phase < up; phase++) {
+            for (int k = 0; k < taps_per_phase; k++) {
+                phases_[phase * taps_per_phase + taps_per_phase - 1 - k] = prototype[phase + k * up];
+            }
+        }
+    }
+
+    void Process(const int16_t* input, size_t input_samples, int16_t* output) {
+        history_.resize(taps_per_phase_ - 1 + input_samples);
+        std::copy(input, input + input_samples, history_.begin() + taps_per_phase_ - 1);
+        int64_t end = (int64_t)input_samples * up_;
+        int64_t position = position_;
+        for (; position < end; position += down_) {
+            const int16_t* h = &phases_[(position % up_) * taps_per_phase_];
+            const int16_t* window = history_.data() + position / up_;
+            int32_t sum = 1 << 13;
+            for (int k = 0; k < taps_per_phase_; k++) {
+                sum += (int32_t)window[k] * h[k];
+            }
+            sum >>= 14;
+            *output++ = sum > INT16_MAX ? INT16_MAX : (sum < INT16_MIN ? INT16_MIN : sum);
+        }
+        position_ = position - end;
+        std::copy(history_.end() - (taps_per_phase_ - 1), history_.end(), history_.begin());
+        history_.resize(taps_per_phase_ - 1);
+    }
+
+private:
+    int up_, down_, taps_per_phase_;
+    std::vector<int16_t> phases_;
+    std::vector<int16_t> history_;
+    int64_t position_ = 0;
+};
+
+// Host timings only show the relative cost, absolute numbers on the target differ
+static void Benchmark(const Ratio& ratio) {
+    using Clock = std::chrono::steady_clock;
+    const size_t chunk = ratio.input_rate / 50;
+    const int chunks = 5000;  // 100 s of audio
+    std::vector<int16_t> input(chunk);
+    for (size_t i = 0; i < chunk; i++) {
+        input[i] = (int16_t)((i * 7919) % 30000 - 15000);
+    }
+    std::vector<int16_t> output(chunk * ratio.up / ratio.down + 2);
+
+    auto resampler = ratio.create();
+    auto start = Clock::now();
+    for (int i = 0; i < chunks; i++) {
+        resampler->Process(input.data(), chunk, output.data());
+    }
+    double specialized = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    GenericResampler generic(ratio.up, ratio.down, ratio.taps_per_phase);
+    start = Clock::now();
+    for (int i = 0; i < chunks; i++) {
+        generic.Process(input.data(), chunk, output.data());
+    }
+    double runtime = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    printf("%5d -> %5d: %.2f us per 20 ms frame, %.2f us with run time parameters (%.1fx)\n",
+        ratio.input_rate, ratio.output_rate, specialized / chunks, runtime / chunks, runtime / specialized);
+}
+
+int main() {
+    for (auto& ratio : kRatios) {
+        TestSnr(ratio);
+        TestPassband(ratio);
+        TestAliasing(ratio);
+    }
+    for (auto& ratio : kRatios) {
+        Benchmark(ratio);
+    }
+    printf("polyphase_resampler_test passed\n");
+    return 0;
+}
@@ -0,0 +1,5 @@
+// Host build stand-in, codecs built for the host have no I2S channels
+#pragma once
+#include "driver/i2s_std.h"
+
+inline esp_err_t i2s_channel_enable(i2s_chan_handle_t) { return ESP_OK; }
@@ -0,0 +1,5 @@
+// Host build stand-in, codecs built for the host have no I2S channels
+#pragma once
+#include "esp_err.h"
+
+typedef struct i2s_channel_obj_t* i2s_chan_handle_t;
@@ -0,0 +1,7 @@
+// Host build stand-in for the ESP-IDF error codes
+#pragma once
+#include <cstdlib>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERROR_CHECK(x) do { if ((x) != ESP_OK) abort(); } while (0)
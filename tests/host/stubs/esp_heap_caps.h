@@ -0,0 +1,10 @@
+// Host build stand-in for the ESP-IDF capability allocator
+#pragma once
+#include <cstdlib>
+#include <cstdint>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+
+inline void* heap_caps_malloc(size_t size, uint32_t /*caps*/) { return malloc(size); }
+inline void heap_caps_free(void* ptr) { free(ptr); }
@@ -0,0 +1,9 @@
+// Host build stand-in for the ESP-IDF logging macros
+#pragma once
+#include <cstdio>
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+// Info and debug are compiled but never printed, so the arguments still count as used
+#define ESP_LOGI(tag, format, ...) do { if (0) fprintf(stderr, "%s" format, tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, format, ...) do { if (0) fprintf(stderr, "%s" format, tag, ##__VA_ARGS__); } while (0)
@@ -0,0 +1,9 @@
+// Host build stand-in for the ESP-IDF high resolution timer clock
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+inline int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,3 @@
+// Host build stand-in, nothing built for the host uses event groups
+#pragma once
+#include "freertos/FreeRTOS.h"
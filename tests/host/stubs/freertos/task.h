@@ -0,0 +1,10 @@
+// Host build stand-in for the FreeRTOS task delay, one tick per millisecond
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+#include <chrono>
+#include <thread>
+
+inline void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
@@ -0,0 +1,74 @@
+// Host build stand-in for the mbedtls AES calls AudioCipher makes, on top of
+// OpenSSL AES-128-ECB. CTR mode follows mbedtls: the 16-byte counter block is
+// a big-endian number advanced in place, nc_off and stream_block carry a
+// partly used keystream block between calls.
+#pragma once
+#include <openssl/evp.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+typedef struct {
+    EVP_CIPHER_CTX* evp;
+} mbedtls_aes_context;
+
+inline void mbedtls_aes_init(mbedtls_aes_context* ctx) {
+    ctx->evp = EVP_CIPHER_CTX_new();
+}
+
+inline void mbedtls_aes_free(mbedtls_aes_context* ctx) {
+    EVP_CIPHER_CTX_free(ctx->evp);
+    ctx->evp = nullptr;
+}
+
+inline int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+    if (keybits != 128 || EVP_EncryptInit_ex(ctx->evp, EVP_aes_128_ecb(), nullptr, key, nullptr) != 1) {
+        return -1;
+    }
+    EVP_CIPHER_CTX_set_padding(ctx->evp, 0);
+    return 0;
+}
+
+inline int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off,
+    unsigned char nonce_counter[16], unsigned char stream_block[16], const unsigned char* input, unsigned char* output) {
+    // Keystream for up to 16 blocks per OpenSSL call
+    unsigned char counters[16 * 16];
+    unsigned char keystream[16 * 16];
+    size_t n = *nc_off;
+    while (length > 0) {
+        if (n != 0) {
+            *output++ = *input++ ^ stream_block[n];
+            n = (n + 1) & 15;
+            length--;
+            continue;
+        }
+        size_t blocks = (length + 15) / 16;
+        blocks = blocks < 16 ? blocks : 16;
+        for (size_t b = 0; b < blocks; b++) {
+            memcpy(counters + b * 16, nonce_counter, 16);
+            for (int i = 16; i > 0; i--) {
+                if (++nonce_counter[i - 1] != 0) {
+                    break;
+                }
+            }
+        }
+        int out_len = 0;
+        if (EVP_EncryptUpdate(ctx->evp, keystream, &out_len, counters, (int)(blocks * 16)) != 1) {
+            return -1;
+        }
+        size_t count = length < blocks * 16 ? length : blocks * 16;
+        for (size_t i = 0; i < count; i++) {
+            output[i] = input[i] ^ keystream[i];
+        }
+        input += count;
+        output += count;
+        length -= count;
+        n = count & 15;
+        if (n != 0) {
+            memcpy(stream_block, keystream + (blocks - 1) * 16, 16);
+        }
+    }
+    *nc_off = n;
+    return 0;
+}
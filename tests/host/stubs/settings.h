@@ -0,0 +1,14 @@
+// Host build stand-in for the NVS backed settings, every key reads as its default
+#pragma once
+#include <cstdint>
+#include <string>
+
+class Settings {
+public:
+    Settings(const std::string&, bool = false) {}
+
+    std::string GetString(const std::string&, const std::string& default_value = "") { return default_value; }
+    void SetString(const std::string&, const std::string&) {}
+    int32_t GetInt(const std::string&, int32_t default_value = 0) { return default_value; }
+    void SetInt(const std::string&, int32_t) {}
+};